@@ -0,0 +1,267 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "red_black_tree.h"
+
+/**
+ * A {@link RedBlackTree} with a write buffer in front of it, for insert-heavy
+ * ingestion. Inserted values are appended to the buffer without searching the
+ * tree; once the buffer holds buffer_capacity values, and at least a
+ * 1 / BATCH_FRACTION part of the size of the tree, it is merged into the tree in
+ * one batch, by building a tree from the sorted batch in linear time and taking
+ * its union with the main tree in time O(m log(n / m + 1)) for a batch of m
+ * values. Since batches grow with the tree, the union costs O(1) node visits per
+ * value, most of them to nodes near the root, in place of a cache-missing
+ * root-to-leaf descent per value.
+ * <p>
+ * The buffer is kept searchable as it grows, in the manner of a log-structured
+ * merge: values are appended to a short unsorted tail, which once full is
+ * sorted into a run, and runs of similar length are merged, so that there are
+ * O(log m) sorted runs and each value is moved O(log m) times, sequentially.
+ * Lookups search the tree, binary search each run and scan the tail, without
+ * modifying anything, so that, as with RedBlackTree, concurrent lookups are
+ * safe in the absence of modification. Removal takes a value out of the tree
+ * and records a buffered one in a tree of removed values, which hides it until
+ * it is inserted again or the buffer is merged. Operations that need the tree
+ * as a whole, such as size and tree, flush the buffer first.
+ */
+template<class T, class NodeType = Node<T>, class Compare = int (*)(const T&, const T&),
+    class Pool = NodePool<NodeType>>
+class BufferedRedBlackTree {
+public:
+  typedef RedBlackTree<T, NodeType, Compare, Pool> Tree;
+
+  static const size_t DEFAULT_BUFFER_CAPACITY = 4096;
+  static const uint32_t BATCH_FRACTION = 4;
+  // The number of values in the unsorted tail of the buffer, which lookups
+  // scan, before it is sorted into a run.
+  static const size_t TAIL_CAPACITY = 32;
+
+  /**
+   * @param compare
+   *            the comparator of values.
+   * @param buffer_capacity
+   *            the least number of buffered values at which the buffer is
+   *            merged into the tree.
+   */
+  explicit BufferedRedBlackTree(const Compare& compare = Compare(),
+      size_t buffer_capacity = DEFAULT_BUFFER_CAPACITY)
+      : compare_(compare), pool_(std::make_shared<Pool>()), tree_(compare, pool_),
+        removed_(compare), buffer_capacity_(buffer_capacity == 0 ? 1 : buffer_capacity),
+        buffered_(0) {
+    tail_.reserve(TAIL_CAPACITY);
+  }
+
+  BufferedRedBlackTree(const BufferedRedBlackTree&) = delete;
+  BufferedRedBlackTree& operator=(const BufferedRedBlackTree&) = delete;
+
+  /**
+   * Insert the specified value into this tree, merging the buffer into the
+   * tree if it is full. A value already present is ignored when the buffer is
+   * merged.
+   *
+   * @param value
+   *            the value to insert.
+   */
+  void insert(const T& value) {
+    insert_buffered(T(value));
+  }
+
+  void insert(T&& value) {
+    insert_buffered(std::move(value));
+  }
+
+  /**
+   * Remove the specified value from this tree.
+   *
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
+   */
+  bool remove(const T& value) {
+    bool removed = false;
+    if (buffered(value)) {
+      removed = removed_.insert(value);
+    }
+    return tree_.remove(value) || removed;
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  bool contains(const T& value) const {
+    return tree_.contains(value) || (buffered(value) && !removed_.contains(value));
+  }
+
+  /**
+   * Merge the buffer into the tree.
+   */
+  void flush() {
+    if (buffered_ == 0) {
+      return;
+    }
+    seal_tail();
+    std::vector<T> batch;
+    for (size_t j = runs_.size(); j > 0; j--) {
+      batch = merge_runs(std::move(runs_[j - 1]), std::move(batch));
+    }
+    runs_.clear();
+    buffered_ = 0;
+    if (removed_.size() != 0) {
+      batch.erase(std::remove_if(batch.begin(), batch.end(),
+          [this](const T& value) { return removed_.contains(value); }), batch.end());
+      removed_.clear();
+    }
+    Tree merged(compare_, pool_);
+    merged.assign(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+    tree_.union_with(std::move(merged));
+  }
+
+  /**
+   * @return the tree holding every value inserted so far, after merging the
+   *         buffer into it.
+   */
+  const Tree& tree() {
+    flush();
+    return tree_;
+  }
+
+  /**
+   * @return the number of values in this tree, after merging the buffer.
+   */
+  uint32_t size() {
+    flush();
+    return tree_.size();
+  }
+
+  /**
+   * @return the number of values waiting in the buffer, which may include
+   *         values already in the tree and values since removed.
+   */
+  size_t buffered_size() const {
+    return buffered_;
+  }
+
+private:
+  Compare compare_;
+  std::shared_ptr<Pool> pool_;
+  Tree tree_;
+  // Buffered values removed since the last merge.
+  RedBlackTree<T, Node<T>, Compare> removed_;
+  size_t buffer_capacity_;
+  // Sorted runs free of duplicates, longest first, each more than twice as
+  // long as the next, followed by the unsorted tail of the buffer.
+  std::vector<std::vector<T>> runs_;
+  std::vector<T> tail_;
+  size_t buffered_;
+
+  bool less(const T& a, const T& b) const {
+    return three_way_compare(compare_, a, b) < 0;
+  }
+
+  void insert_buffered(T&& value) {
+    if (removed_.size() != 0) {
+      removed_.remove(value);
+    }
+    tail_.push_back(std::move(value));
+    buffered_++;
+    if (tail_.size() == TAIL_CAPACITY) {
+      seal_tail();
+    }
+    if (buffered_ >= buffer_capacity_ && buffered_ >= tree_.size() / BATCH_FRACTION) {
+      flush();
+    }
+  }
+
+  /**
+   * Sort the tail into a run, merging it with the shorter runs before it so
+   * that run lengths stay geometric.
+   */
+  void seal_tail() {
+    if (tail_.empty()) {
+      return;
+    }
+    auto less = [this](const T& a, const T& b) { return this->less(a, b); };
+    std::sort(tail_.begin(), tail_.end(), less);
+    tail_.erase(std::unique(tail_.begin(), tail_.end(),
+        [this](const T& a, const T& b) { return !this->less(a, b); }), tail_.end());
+    std::vector<T> run = std::move(tail_);
+    while (!runs_.empty() && runs_.back().size() <= 2 * run.size()) {
+      run = merge_runs(std::move(runs_.back()), std::move(run));
+      runs_.pop_back();
+    }
+    runs_.push_back(std::move(run));
+    tail_.clear();
+    tail_.reserve(TAIL_CAPACITY);
+  }
+
+  /**
+   * @return the union of the specified sorted runs, free of duplicates.
+   */
+  std::vector<T> merge_runs(std::vector<T>&& a, std::vector<T>&& b) const {
+    if (a.empty()) {
+      return std::move(b);
+    }
+    if (b.empty()) {
+      return std::move(a);
+    }
+    std::vector<T> result;
+    result.reserve(a.size() + b.size());
+    std::set_union(std::make_move_iterator(a.begin()), std::make_move_iterator(a.end()),
+        std::make_move_iterator(b.begin()), std::make_move_iterator(b.end()),
+        std::back_inserter(result), [this](const T& x, const T& y) { return this->less(x, y); });
+    return result;
+  }
+
+  /**
+   * Test whether or not the specified value is in the buffer, removed or not.
+   */
+  bool buffered(const T& value) const {
+    auto less = [this](const T& a, const T& b) { return this->less(a, b); };
+    for (const std::vector<T>& run : runs_) {
+      typename std::vector<T>::const_iterator i =
+          std::lower_bound(run.begin(), run.end(), value, less);
+      if (i != run.end() && !this->less(value, *i)) {
+        return true;
+      }
+    }
+    for (const T& pending : tail_) {
+      if (!this->less(value, pending) && !this->less(pending, value)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
@@ -0,0 +1,323 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "red_black_tree.h"
+
+template<class NodeType>
+class CompactNodePool;
+
+/**
+ * A red-black tree node whose links are 32-bit offsets, counted in nodes, from
+ * the node itself to the node linked, and whose color occupies the low bit of
+ * the parent link. A CompactNode<int> takes 16 bytes where a Node<int> takes
+ * 32 and a LinkedNode<int> 48, so that four fit in a cache line.
+ * <p>
+ * Because links are relative, every node of a tree must be allocated from a
+ * single contiguous block, as a {@link CompactNodePool} does, and the block as
+ * a whole may be moved or copied bytewise without invalidating the tree. An
+ * offset of zero encodes null, since no node links to itself.
+ *
+ * @author Kevin L. Stern
+ */
+template<class T>
+class CompactNode {
+public:
+  template<class... Args>
+  explicit CompactNode(Args&&... args) : left_(0), right_(0), parent_(BLACK),
+      value_(std::forward<Args>(args)...) {}
+
+  NodeColor color() const {
+    return static_cast<NodeColor>(parent_ & 1);
+  }
+
+  CompactNode* left() {
+    return resolve(left_);
+  }
+
+  const CompactNode* left() const {
+    return resolve(left_);
+  }
+
+  CompactNode* right() {
+    return resolve(right_);
+  }
+
+  const CompactNode* right() const {
+    return resolve(right_);
+  }
+
+  CompactNode* parent() {
+    return resolve(static_cast<int32_t>(parent_) >> 1);
+  }
+
+  const CompactNode* parent() const {
+    return resolve(static_cast<int32_t>(parent_) >> 1);
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+  bool is_leaf() const {
+    return left_ == 0 && right_ == 0;
+  }
+
+private:
+  int32_t left_;
+  int32_t right_;
+  uint32_t parent_;
+  T value_;
+
+  CompactNode* resolve(int32_t offset) const {
+    return offset == 0 ? nullptr : const_cast<CompactNode*>(this) + offset;
+  }
+
+  int32_t offset_of(const CompactNode* node) const {
+    return node == nullptr ? 0 : static_cast<int32_t>(node - this);
+  }
+
+  void set_left(CompactNode* node) {
+    left_ = offset_of(node);
+  }
+
+  void set_right(CompactNode* node) {
+    right_ = offset_of(node);
+  }
+
+  void set_parent(CompactNode* node) {
+    parent_ = (static_cast<uint32_t>(offset_of(node)) << 1) | (parent_ & 1);
+  }
+
+  void set_color(NodeColor color) {
+    parent_ = (parent_ & ~1u) | static_cast<uint32_t>(color);
+  }
+
+  template<class, class, class, class>
+  friend class RedBlackTree;
+};
+
+/**
+ * A pool that allocates nodes from a single contiguous array, as required by
+ * {@link CompactNode}, and grows by doubling the array. Released nodes are
+ * threaded onto a free list of 32-bit indices and reused.
+ * <p>
+ * Growing moves every node, so the pool keeps a list of anchors, pointers into
+ * the array that it rebases whenever it moves the array; a {@link RedBlackTree}
+ * anchors its root. Any other pointer to a node is invalidated by an
+ * allocation, reserve or absorb that grows the pool. Nodes are moved bytewise,
+ * so the node type must be trivially copyable.
+ *
+ * @author Kevin L. Stern
+ */
+template<class NodeType>
+class CompactNodePool {
+public:
+  static const size_t INITIAL_CAPACITY = 32;
+  // Parent links spend one bit on the color, leaving 31 bits of offset.
+  static const size_t MAX_CAPACITY = size_t(1) << 30;
+
+  CompactNodePool() : nodes_(nullptr), free_(NIL), next_(0), capacity_(0), live_(0) {}
+
+  CompactNodePool(const CompactNodePool&) = delete;
+  CompactNodePool& operator=(const CompactNodePool&) = delete;
+
+  ~CompactNodePool() {
+    ::operator delete(nodes_);
+  }
+
+  /**
+   * Construct a new node from the specified arguments in storage owned by this
+   * pool, growing the pool if no storage is free.
+   */
+  template<class... Args>
+  NodeType* allocate(Args&&... args) {
+    uint32_t index = free_;
+    if (index != NIL) {
+      std::memcpy(&free_, nodes_ + index, sizeof(free_));
+    } else {
+      if (next_ == capacity_) {
+        grow(next_ + 1);
+      }
+      index = next_++;
+    }
+    ++live_;
+    return new (nodes_ + index) NodeType(std::forward<Args>(args)...);
+  }
+
+  /**
+   * Destroy the specified node, which must have been allocated by this pool,
+   * and make its storage available to subsequent allocations.
+   */
+  void release(NodeType* node) {
+    node->~NodeType();
+    release_slot(static_cast<uint32_t>(node - nodes_));
+    --live_;
+  }
+
+  /**
+   * Ensure that the next count allocations which are not served from the free
+   * list do not grow the pool.
+   */
+  void reserve(size_t count) {
+    if (capacity_ - next_ < count) {
+      grow(next_ + count);
+    }
+  }
+
+  /**
+   * Take over the nodes of the specified pool, which are copied to the end of
+   * this pool's array, together with its free storage and anchors. The other
+   * pool is left empty. Runs in time linear in the size of the other pool.
+   *
+   * @return true, as nodes are copied and so can always change hands.
+   */
+  bool absorb(CompactNodePool& other) {
+    if (&other == this) {
+      return true;
+    }
+    reserve(other.next_);
+    uint32_t base = static_cast<uint32_t>(next_);
+    if (other.next_ != 0) {
+      std::memcpy(static_cast<void*>(nodes_ + base), other.nodes_,
+          other.next_ * sizeof(NodeType));
+    }
+    next_ += other.next_;
+    while (other.free_ != NIL) {
+      uint32_t index = other.free_;
+      std::memcpy(&other.free_, other.nodes_ + index, sizeof(other.free_));
+      release_slot(base + index);
+    }
+    for (NodeType** anchor : other.anchors_) {
+      if (*anchor != nullptr) {
+        *anchor = nodes_ + base + (*anchor - other.nodes_);
+      }
+      anchors_.push_back(anchor);
+    }
+    live_ += other.live_;
+    ::operator delete(other.nodes_);
+    other.nodes_ = nullptr;
+    other.next_ = 0;
+    other.capacity_ = 0;
+    other.live_ = 0;
+    other.anchors_.clear();
+    return true;
+  }
+
+  /**
+   * Register a pointer to a node of this pool, or null, to be kept up to date
+   * when the pool moves its nodes.
+   */
+  void track(NodeType** anchor) {
+    anchors_.push_back(anchor);
+  }
+
+  /**
+   * Unregister a pointer registered with {@link #track}.
+   */
+  void untrack(NodeType** anchor) {
+    for (size_t j = anchors_.size(); j-- > 0;) {
+      if (anchors_[j] == anchor) {
+        anchors_[j] = anchors_.back();
+        anchors_.pop_back();
+        return;
+      }
+    }
+  }
+
+  /**
+   * @return the number of nodes currently allocated from this pool.
+   */
+  size_t size() const {
+    return live_;
+  }
+
+  /**
+   * @return the number of nodes that fit in the array of this pool.
+   */
+  size_t capacity() const {
+    return capacity_;
+  }
+
+private:
+  static_assert(std::is_trivially_copyable<NodeType>::value,
+      "CompactNodePool moves nodes bytewise");
+  static_assert(sizeof(NodeType) >= sizeof(uint32_t), "free list links do not fit in a node");
+
+  static const uint32_t NIL = UINT32_MAX;
+
+  NodeType* nodes_;
+  uint32_t free_;
+  size_t next_;
+  size_t capacity_;
+  size_t live_;
+  std::vector<NodeType**> anchors_;
+
+  void release_slot(uint32_t index) {
+    std::memcpy(static_cast<void*>(nodes_ + index), &free_, sizeof(free_));
+    free_ = index;
+  }
+
+  /**
+   * Move the nodes to a new array of at least the specified capacity, and at
+   * least double the current capacity where the limit permits.
+   */
+  void grow(size_t required) {
+    if (required > MAX_CAPACITY) {
+      throw std::length_error("CompactNodePool is full");
+    }
+    size_t capacity = std::max(required, 2 * capacity_);
+    if (capacity < INITIAL_CAPACITY) {
+      capacity = INITIAL_CAPACITY;
+    } else if (capacity > MAX_CAPACITY) {
+      capacity = MAX_CAPACITY;
+    }
+    NodeType* nodes = static_cast<NodeType*>(::operator new(capacity * sizeof(NodeType)));
+    if (next_ != 0) {
+      std::memcpy(static_cast<void*>(nodes), nodes_, next_ * sizeof(NodeType));
+    }
+    for (NodeType** anchor : anchors_) {
+      if (*anchor != nullptr) {
+        *anchor = nodes + (*anchor - nodes_);
+      }
+    }
+    ::operator delete(nodes_);
+    nodes_ = nodes;
+    capacity_ = capacity;
+  }
+};
+
+/**
+ * A {@link RedBlackTree} of {@link CompactNode}s.
+ */
+template<class T, class Compare = int (*)(const T&, const T&)>
+using CompactRedBlackTree = RedBlackTree<T, CompactNode<T>, Compare,
+    CompactNodePool<CompactNode<T>>>;
@@ -0,0 +1,216 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "persistent_red_black_tree.h"
+
+/**
+ * A red-black tree for read-mostly concurrent use: any number of threads may
+ * look values up and scan ranges without taking locks, while modifications
+ * are serialized by a writer lock.
+ * <p>
+ * The writer modifies a private {@link PersistentRedBlackTree}, which copies
+ * only the nodes that are shared with the published version, and then
+ * publishes the new version with a single atomic store, in the manner of
+ * read-copy-update. A reader enters a read-side critical section by
+ * registering on one of two counters selected by the parity of a global epoch,
+ * and then reads whichever version is published. Before it frees the nodes of
+ * a superseded version, the writer advances the epoch and waits for the
+ * counter of the previous parity to drain: every reader that might have seen
+ * the old version registered on that counter, and every reader registering
+ * after the advance sees the new version. Readers take no lock, but retry
+ * their registration if the epoch advances under them, so that under steady
+ * write churn they may spin; a writer waits at most for the read-side critical
+ * sections in progress when it publishes.
+ *
+ * @see McKenney and Slingwine. Read-Copy Update: Using Execution History to
+ *      Solve Concurrency Problems. PDCS 1998.
+ */
+template<class T, class Compare = int (*)(const T&, const T&)>
+class ConcurrentRedBlackTree {
+public:
+  typedef PersistentRedBlackTree<T, Compare> Snapshot;
+
+  explicit ConcurrentRedBlackTree(const Compare& compare = Compare())
+      : tree_(compare), published_(new Snapshot(compare)), epoch_(0) {
+    readers_[0].count.store(0);
+    readers_[1].count.store(0);
+  }
+
+  ConcurrentRedBlackTree(const ConcurrentRedBlackTree&) = delete;
+  ConcurrentRedBlackTree& operator=(const ConcurrentRedBlackTree&) = delete;
+
+  /**
+   * Destructor. No reader may be active.
+   */
+  ~ConcurrentRedBlackTree() {
+    delete published_.load();
+  }
+
+  /**
+   * Insert the specified value into this tree.
+   *
+   * @param value
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
+   */
+  bool insert(const T& value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!tree_.insert(value)) {
+      return false;
+    }
+    publish();
+    return true;
+  }
+
+  /**
+   * Remove the specified value from this tree.
+   *
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
+   */
+  bool remove(const T& value) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    if (!tree_.remove(value)) {
+      return false;
+    }
+    publish();
+    return true;
+  }
+
+  /**
+   * Apply the specified function to the writer's tree, a Snapshot passed by
+   * reference, under the writer lock, and publish the result as a single new
+   * version. Readers observe either none or all of the modifications made by
+   * the function.
+   */
+  template<class Function>
+  void update(Function function) {
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    function(tree_);
+    publish();
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree. Does
+   * not block.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  template<class K>
+  bool contains(const K& value) const {
+    ReadGuard guard(*this);
+    return guard.tree().contains(value);
+  }
+
+  /**
+   * Apply the specified function to each value v of this tree with lo <= v <=
+   * hi, in order, as of a single point in time. Does not block; the function
+   * runs inside a read-side critical section and so should not itself wait for
+   * writers.
+   */
+  template<class K, class Function>
+  void for_each_in_range(const K& lo, const K& hi, Function function) const {
+    ReadGuard guard(*this);
+    guard.tree().for_each_in_range(lo, hi, function);
+  }
+
+  uint32_t size() const {
+    ReadGuard guard(*this);
+    return guard.tree().size();
+  }
+
+  /**
+   * Get a point-in-time copy of this tree, which may be read at leisure and
+   * from any thread without delaying writers. Does not block.
+   */
+  Snapshot snapshot() const {
+    ReadGuard guard(*this);
+    return guard.tree();
+  }
+
+private:
+  struct alignas(64) ReaderCount {
+    std::atomic<uint64_t> count;
+  };
+
+  /**
+   * Scope of a read-side critical section, during which the published version
+   * is not freed.
+   */
+  class ReadGuard {
+  public:
+    explicit ReadGuard(const ConcurrentRedBlackTree& owner) : owner_(owner) {
+      for (;;) {
+        uint64_t epoch = owner_.epoch_.load();
+        parity_ = epoch & 1;
+        owner_.readers_[parity_].count.fetch_add(1);
+        if (owner_.epoch_.load() == epoch) {
+          break;
+        }
+        owner_.readers_[parity_].count.fetch_sub(1);
+      }
+      tree_ = owner_.published_.load();
+    }
+
+    ~ReadGuard() {
+      owner_.readers_[parity_].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    const Snapshot& tree() const {
+      return *tree_;
+    }
+
+  private:
+    const ConcurrentRedBlackTree& owner_;
+    uint64_t parity_;
+    const Snapshot* tree_;
+  };
+
+  std::mutex writer_mutex_;
+  Snapshot tree_;
+  std::atomic<Snapshot*> published_;
+  std::atomic<uint64_t> epoch_;
+  mutable ReaderCount readers_[2];
+
+  /**
+   * Publish the writer's tree and free the superseded version once no reader
+   * can be using it. Called under the writer lock.
+   */
+  void publish() {
+    Snapshot* previous = published_.exchange(new Snapshot(tree_));
+    uint64_t epoch = epoch_.load();
+    epoch_.store(epoch + 1);
+    while (readers_[epoch & 1].count.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+    delete previous;
+  }
+};
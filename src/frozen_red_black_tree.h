@@ -0,0 +1,481 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "red_black_tree.h"
+
+/**
+ * An immutable sorted set, built once from a sorted range, for instance by
+ * {@link RedBlackTree#freeze}, and laid out for fast searching.
+ * <p>
+ * Values are stored in a single array in Eytzinger (breadth-first) order: the
+ * root of the implicit search tree is at index 1 and the children of the node
+ * at index k are at indices 2k and 2k + 1. A search descends by arithmetic
+ * alone, without branching on the outcome of each comparison, so that it
+ * suffers no mispredictions; and since the nodes four levels below index k are
+ * contiguous, the search prefetches them while it works its way down to them,
+ * so that the cache misses of consecutive levels overlap.
+ * <p>
+ * The array holds no pointers, so for trivially copyable T it doubles as a
+ * file format: {@link #save} writes a versioned image, which {@link #view}
+ * queries in place, for instance after mapping the file into memory with
+ * mmap, and {@link #load} copies.
+ *
+ * @see Khuong and Morin. Array Layouts for Comparison-Based Searching. ACM
+ *      Journal of Experimental Algorithmics 22, 2017.
+ *
+ * @author Kevin L. Stern
+ */
+template<class T, class Compare>
+class FrozenRedBlackTree {
+public:
+  /**
+   * An in-order iterator over the values of a FrozenRedBlackTree.
+   */
+  class const_iterator {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    const_iterator() : owner_(nullptr), index_(0) {}
+
+    reference operator*() const {
+      return owner_->values_[index_];
+    }
+
+    pointer operator->() const {
+      return &owner_->values_[index_];
+    }
+
+    const_iterator& operator++() {
+      index_ = owner_->next(index_);
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator result = *this;
+      ++*this;
+      return result;
+    }
+
+    const_iterator& operator--() {
+      index_ = index_ == 0 ? owner_->last() : owner_->previous(index_);
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator result = *this;
+      --*this;
+      return result;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return index_ == other.index_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return index_ != other.index_;
+    }
+
+  private:
+    const FrozenRedBlackTree* owner_;
+    // The Eytzinger index of the value, zero at the end.
+    size_t index_;
+
+    const_iterator(const FrozenRedBlackTree* owner, size_t index) : owner_(owner), index_(index) {}
+
+    friend class FrozenRedBlackTree;
+  };
+
+  typedef const_iterator iterator;
+
+  explicit FrozenRedBlackTree(const Compare& compare = Compare())
+      : compare_(compare), values_(nullptr), size_(0) {}
+
+  /**
+   * Construct a tree holding the values in the specified range, which must be
+   * sorted in ascending order and free of duplicates, in time O(n).
+   *
+   * @param begin
+   *            the beginning of the sorted range, a forward iterator.
+   * @param end
+   *            the end of the sorted range.
+   */
+  template<class Iterator>
+  FrozenRedBlackTree(Iterator begin, Iterator end, const Compare& compare = Compare())
+      : compare_(compare), values_(nullptr), size_(0) {
+    size_t count = static_cast<size_t>(std::distance(begin, end));
+    if (count == 0) {
+      return;
+    }
+    // Fill every slot with the first value, so that T need not be default
+    // constructible, then lay the values out by Eytzinger index in a single
+    // in-order pass over the range; index 0 is unused.
+    storage_.assign(count + 1, *begin);
+    fill_in_order(1, begin);
+    values_ = storage_.data();
+    size_ = count;
+  }
+
+  FrozenRedBlackTree(const FrozenRedBlackTree& other)
+      : compare_(other.compare_), storage_(other.storage_), values_(other.values_),
+        size_(other.size_) {
+    if (!storage_.empty()) {
+      values_ = storage_.data();
+    }
+  }
+
+  FrozenRedBlackTree& operator=(const FrozenRedBlackTree& other) {
+    if (this != &other) {
+      compare_ = other.compare_;
+      storage_ = other.storage_;
+      values_ = storage_.empty() ? other.values_ : storage_.data();
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  // Moving a vector keeps its buffer, so values_ remains valid.
+  FrozenRedBlackTree(FrozenRedBlackTree&&) = default;
+  FrozenRedBlackTree& operator=(FrozenRedBlackTree&&) = default;
+
+  /**
+   * Write the image of this tree, a header followed by the array of values,
+   * to the specified stream, which should be in binary mode.
+   */
+  void save(std::ostream& out) const {
+    static_assert(std::is_trivially_copyable<T>::value, "values must be trivially copyable");
+    ImageHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, image_magic(), sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.byte_order = IMAGE_BYTE_ORDER;
+    header.value_size = sizeof(T);
+    header.value_alignment = alignof(T);
+    header.size = size_;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (size_ != 0) {
+      out.write(reinterpret_cast<const char*>(values_), (size_ + 1) * sizeof(T));
+    }
+    if (!out) {
+      throw std::runtime_error("Failed to write image");
+    }
+  }
+
+  /**
+   * Get a tree over the image at the specified address, as written by {@link
+   * #save}, without copying it. The image must be aligned for T and must
+   * outlive the tree and its copies.
+   *
+   * @param image
+   *            the address of the image.
+   * @param length
+   *            the length of the image in bytes.
+   */
+  static FrozenRedBlackTree view(const void* image, size_t length,
+      const Compare& compare = Compare()) {
+    static_assert(std::is_trivially_copyable<T>::value, "values must be trivially copyable");
+    if (reinterpret_cast<uintptr_t>(image) % alignof(T) != 0) {
+      throw std::runtime_error("Misaligned image");
+    }
+    ImageHeader header;
+    if (length < sizeof(header)) {
+      throw std::runtime_error("Truncated image");
+    }
+    std::memcpy(&header, image, sizeof(header));
+    FrozenRedBlackTree result(compare);
+    result.size_ = read_header(header);
+    if (result.size_ != 0) {
+      // Index 0 is stored too, so the image holds size_ + 1 values.
+      if (result.size_ >= (length - sizeof(header)) / sizeof(T)) {
+        throw std::runtime_error("Truncated image");
+      }
+      result.values_ = reinterpret_cast<const T*>(static_cast<const char*>(image) + sizeof(ImageHeader));
+    }
+    return result;
+  }
+
+  /**
+   * Read an image written by {@link #save} from the specified stream into a
+   * tree owning a copy of it.
+   */
+  static FrozenRedBlackTree load(std::istream& in, const Compare& compare = Compare()) {
+    static_assert(std::is_trivially_copyable<T>::value, "values must be trivially copyable");
+    ImageHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in) {
+      throw std::runtime_error("Truncated image");
+    }
+    FrozenRedBlackTree result(compare);
+    result.size_ = read_header(header);
+    if (result.size_ != 0) {
+      // Grow the storage as the values arrive rather than trusting the header
+      // with one allocation, so that a corrupt size fails at the end of the
+      // stream instead of exhausting memory.
+      size_t count = result.size_ + 1;
+      size_t loaded = 0;
+      while (loaded < count) {
+        size_t chunk = loaded < LOAD_CHUNK ? LOAD_CHUNK : loaded;
+        chunk = std::min(chunk, count - loaded);
+        result.storage_.resize(loaded + chunk);
+        in.read(reinterpret_cast<char*>(result.storage_.data() + loaded), chunk * sizeof(T));
+        if (!in) {
+          throw std::runtime_error("Truncated image");
+        }
+        loaded += chunk;
+      }
+      result.values_ = result.storage_.data();
+    }
+    return result;
+  }
+
+  /**
+   * @return an iterator to the least value of this tree not less than the
+   *         specified key, or end() if there is none.
+   */
+  template<class K>
+  const_iterator lower_bound(const K& key) const {
+    return const_iterator(this, search(key, 0));
+  }
+
+  /**
+   * @return an iterator to the least value of this tree greater than the
+   *         specified key, or end() if there is none.
+   */
+  template<class K>
+  const_iterator upper_bound(const K& key) const {
+    return const_iterator(this, search(key, 1));
+  }
+
+  /**
+   * @return an iterator to the value of this tree equal to the specified key,
+   *         or end() if there is none.
+   */
+  template<class K>
+  const_iterator find(const K& key) const {
+    size_t index = search(key, 0);
+    if (index != 0 && three_way_compare(compare_, values_[index], key) != 0) {
+      index = 0;
+    }
+    return const_iterator(this, index);
+  }
+
+  /**
+   * Test whether or not the specified key is an element of this tree.
+   */
+  template<class K>
+  bool contains(const K& key) const {
+    size_t index = search(key, 0);
+    return index != 0 && three_way_compare(compare_, values_[index], key) == 0;
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, first());
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, 0);
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+private:
+  // The number of levels by which prefetching runs ahead of the search: the
+  // 2^PREFETCH_LEVELS descendants of a node at this depth below it are
+  // contiguous, and fill a cache line for 4-byte values.
+  static const unsigned PREFETCH_LEVELS = 4;
+
+  static const uint32_t IMAGE_VERSION = 1;
+  static const uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+  // The number of values that load() reads before it grows its storage
+  // geometrically.
+  static const size_t LOAD_CHUNK = 4096;
+
+  /**
+   * The header of an image, padded so that the values which follow it are
+   * aligned to a cache line. Index 0 of the values, which is unused, is
+   * written too, so that the array is the same on disk and in memory.
+   */
+  struct alignas(64) ImageHeader {
+    char magic[8];
+    uint32_t version;
+    // Written in the byte order of the writer, to detect a reader of the other.
+    uint32_t byte_order;
+    uint32_t value_size;
+    uint32_t value_alignment;
+    uint64_t size;
+  };
+
+  Compare compare_;
+  // Values in Eytzinger order, from index 1; either storage_.data() or an
+  // image owned by the caller.
+  std::vector<T> storage_;
+  const T* values_;
+  size_t size_;
+
+  static const char* image_magic() {
+    return "RBTREE\0\0";
+  }
+
+  /**
+   * Validate the specified image header against T.
+   *
+   * @return the number of values in the image.
+   */
+  static size_t read_header(const ImageHeader& header) {
+    static_assert(alignof(T) <= alignof(ImageHeader), "values would be misaligned");
+    if (std::memcmp(header.magic, image_magic(), sizeof(header.magic)) != 0
+        || header.byte_order != IMAGE_BYTE_ORDER) {
+      throw std::runtime_error("Not an image");
+    }
+    if (header.version != IMAGE_VERSION || header.value_size != sizeof(T)
+        || header.value_alignment != alignof(T)) {
+      throw std::runtime_error("Incompatible image");
+    }
+    // The image holds size + 1 values, whose length in bytes must fit a size_t.
+    if (header.size >= std::numeric_limits<size_t>::max() / sizeof(T)) {
+      throw std::runtime_error("Corrupt image");
+    }
+    return static_cast<size_t>(header.size);
+  }
+
+  /**
+   * Assign the values at the specified iterator onward to the subtree rooted
+   * at Eytzinger index k, in order, advancing the iterator past them.
+   */
+  template<class Iterator>
+  void fill_in_order(size_t k, Iterator& next) {
+    if (k < storage_.size()) {
+      fill_in_order(2 * k, next);
+      storage_[k] = *next;
+      ++next;
+      fill_in_order(2 * k + 1, next);
+    }
+  }
+
+  /**
+   * Find the least value greater than key, if strict is 1, or not less than
+   * key, if strict is 0.
+   *
+   * @return the Eytzinger index of the value, zero if there is none.
+   */
+  template<class K>
+  inline size_t search(const K& key, int strict) const {
+    size_t count = size_;
+    const T* values = values_;
+    size_t k = 1;
+    while (k <= count) {
+      prefetch(values, k << PREFETCH_LEVELS);
+      k = 2 * k + (three_way_compare(compare_, values[k], key) < strict);
+    }
+    // The descent went right after each comparison that ruled the node out
+    // and left at the answer; undo the right turns since then, and the left.
+    return k >> (trailing_ones(k) + 1);
+  }
+
+  static inline void prefetch(const T* values, size_t index) {
+#if defined(__GNUC__)
+    // Prefetching does not fault, so the address may lie past the end.
+    __builtin_prefetch(reinterpret_cast<const char*>(values) + index * sizeof(T));
+#endif
+  }
+
+  static inline unsigned trailing_ones(size_t k) {
+#if defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_ctzll(~static_cast<unsigned long long>(k)));
+#else
+    unsigned result = 0;
+    for (; (k & 1) != 0; k >>= 1) {
+      ++result;
+    }
+    return result;
+#endif
+  }
+
+  size_t first() const {
+    if (empty()) {
+      return 0;
+    }
+    size_t k = 1;
+    while (2 * k <= size()) {
+      k = 2 * k;
+    }
+    return k;
+  }
+
+  size_t last() const {
+    if (empty()) {
+      return 0;
+    }
+    size_t k = 1;
+    while (2 * k + 1 <= size()) {
+      k = 2 * k + 1;
+    }
+    return k;
+  }
+
+  size_t next(size_t k) const {
+    if (2 * k + 1 <= size()) {
+      k = 2 * k + 1;
+      while (2 * k <= size()) {
+        k = 2 * k;
+      }
+      return k;
+    }
+    // Climb past the ancestors of which k lies in the right subtree.
+    return k >> (trailing_ones(k) + 1);
+  }
+
+  size_t previous(size_t k) const {
+    if (2 * k <= size()) {
+      k = 2 * k;
+      while (2 * k + 1 <= size()) {
+        k = 2 * k + 1;
+      }
+      return k;
+    }
+    while (k != 0 && (k & 1) == 0) {
+      k >>= 1;
+    }
+    return k >> 1;
+  }
+};
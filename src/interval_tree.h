@@ -0,0 +1,234 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "red_black_tree.h"
+
+/**
+ * A closed interval [lo, hi] of keys, ordered by lo and then by hi.
+ */
+template<class K>
+struct Interval {
+  K lo;
+  K hi;
+
+  Interval() : lo(), hi() {}
+
+  Interval(const K& lo, const K& hi) : lo(lo), hi(hi) {}
+
+  bool operator<(const Interval& other) const {
+    return lo < other.lo || (!(other.lo < lo) && hi < other.hi);
+  }
+
+  bool operator==(const Interval& other) const {
+    return !(lo < other.lo) && !(other.lo < lo) && !(hi < other.hi) && !(other.hi < hi);
+  }
+};
+
+/**
+ * The {@link AugmentedNode} policy of an interval tree: the aggregate of a
+ * subtree is the largest hi among its intervals.
+ */
+template<class T, class K>
+struct MaxEndPolicy {
+  typedef K value_type;
+
+  static value_type identity() {
+    return std::numeric_limits<K>::lowest();
+  }
+
+  static value_type lift(const T& interval) {
+    return interval.hi;
+  }
+
+  static value_type combine(const value_type& left, const value_type& right) {
+    return left < right ? right : left;
+  }
+};
+
+/**
+ * An interval tree: a {@link RedBlackTree} of closed intervals, ordered by
+ * their lower ends, whose nodes are augmented with the largest upper end in
+ * their subtrees, which lets a search for the intervals overlapping a query
+ * skip every subtree that ends before the query begins.
+ * <p>
+ * The element type T is {@link Interval} or any type with public members lo
+ * and hi of an arithmetic key type, for instance an interval carrying an
+ * identifier; Compare must order T by lo first. Reporting the k intervals that
+ * overlap a query takes time O(min(n, (k + 1) log n)).
+ *
+ * @see Introduction to Algorithms Cormen, Leiserson, Rivest, and Stein.
+ *      Introduction to Algorithms. 2nd ed. Cambridge, MA: MIT Press, 2001.
+ *      Section 14.3.
+ */
+template<class T, class Compare = std::less<T>>
+class IntervalTree {
+public:
+  typedef typename std::decay<decltype(std::declval<T>().lo)>::type key_type;
+  typedef AugmentedNode<T, MaxEndPolicy<T, key_type>> NodeType;
+  typedef RedBlackTree<T, NodeType, Compare> Tree;
+  typedef typename Tree::const_iterator const_iterator;
+
+  explicit IntervalTree(const Compare& compare = Compare()) : tree_(compare) {}
+
+  /**
+   * Construct a tree holding the intervals in the specified range, which must
+   * be sorted by Compare and free of duplicates, in time O(n).
+   */
+  template<class Iterator>
+  IntervalTree(Iterator begin, Iterator end, const Compare& compare = Compare())
+      : tree_(begin, end, compare) {}
+
+  bool insert(const T& interval) {
+    return tree_.insert(interval);
+  }
+
+  bool remove(const T& interval) {
+    return tree_.remove(interval);
+  }
+
+  bool contains(const T& interval) const {
+    return tree_.contains(interval);
+  }
+
+  uint32_t size() const {
+    return tree_.size();
+  }
+
+  const_iterator begin() const {
+    return tree_.begin();
+  }
+
+  const_iterator end() const {
+    return tree_.end();
+  }
+
+  /**
+   * Apply the specified function to each interval of this tree that contains
+   * the specified point, in order.
+   */
+  template<class Function>
+  void overlapping(const key_type& point, Function function) const {
+    overlapping(point, point, function);
+  }
+
+  /**
+   * Apply the specified function to each interval of this tree that overlaps
+   * the closed interval [lo, hi], in order.
+   */
+  template<class Function>
+  void overlapping(const key_type& lo, const key_type& hi, Function function) const {
+    if (!(hi < lo)) {
+      search(tree_.root(), lo, hi, function);
+    }
+  }
+
+  /**
+   * Answer a batch of overlap queries in a single traversal of the tree, for
+   * each pair of a query and an interval overlapping it applying the specified
+   * function as function(index, interval), where index is the position of the
+   * query within the batch. Each node is visited at most once, carrying the
+   * queries that may overlap its subtree, so that a large batch reads each
+   * part of the tree from memory once rather than once per query. Results are
+   * reported in order of interval, not grouped by query.
+   *
+   * @param begin
+   *            the beginning of the queries, a random access iterator over
+   *            values with members lo and hi, such as Interval<key_type>.
+   * @param end
+   *            the end of the queries.
+   */
+  template<class Iterator, class Function>
+  void overlapping_batch(Iterator begin, Iterator end, Function function) const {
+    std::vector<std::vector<uint32_t>> active(1);
+    for (Iterator iter = begin; iter != end; ++iter) {
+      if (!(iter->hi < iter->lo)) {
+        active[0].push_back(static_cast<uint32_t>(iter - begin));
+      }
+    }
+    search_batch(tree_.root(), begin, active, 0, function);
+  }
+
+private:
+  Tree tree_;
+
+  template<class Function>
+  static void search(const NodeType* node, const key_type& lo, const key_type& hi,
+      Function& function) {
+    while (node != nullptr && !(node->aggregate() < lo)) {
+      search(node->left(), lo, hi, function);
+      if (hi < node->value().lo) {
+        // Every interval to the right begins after hi.
+        return;
+      }
+      if (!(node->value().hi < lo)) {
+        function(node->value());
+      }
+      node = node->right();
+    }
+  }
+
+  template<class Iterator, class Function>
+  static void search_batch(const NodeType* node, Iterator queries,
+      std::vector<std::vector<uint32_t>>& active, size_t depth, Function& function) {
+    if (node == nullptr) {
+      return;
+    }
+    if (active.size() == depth + 1) {
+      active.emplace_back();
+    }
+    // Queries beginning after every interval of the subtree ends are dropped.
+    std::vector<uint32_t>* next = &active[depth + 1];
+    next->clear();
+    for (uint32_t index : active[depth]) {
+      if (!(node->aggregate() < queries[index].lo)) {
+        next->push_back(index);
+      }
+    }
+    if (next->empty()) {
+      return;
+    }
+    search_batch(node->left(), queries, active, depth + 1, function);
+    // The recursion reused, and may have moved, the buffer of the next level;
+    // rebuild it for the node itself and its right subtree, which begin at or
+    // after node->lo.
+    next = &active[depth + 1];
+    next->clear();
+    for (uint32_t index : active[depth]) {
+      const auto& query = queries[index];
+      if (!(node->aggregate() < query.lo) && !(query.hi < node->value().lo)) {
+        next->push_back(index);
+        if (!(node->value().hi < query.lo)) {
+          function(static_cast<size_t>(index), node->value());
+        }
+      }
+    }
+    search_batch(node->right(), queries, active, depth + 1, function);
+  }
+};
@@ -0,0 +1,281 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define NODE_POOL_HAS_PMR 1
+#endif
+#endif
+
+/**
+ * Whether deallocation through the specified allocator is a no-op, as for an
+ * allocator drawing on a monotonic arena whose storage is reclaimed all at
+ * once. Owners of such storage may skip freeing it piecemeal.
+ */
+template<class Allocator>
+inline bool is_monotonic(const Allocator&) {
+  return false;
+}
+
+#ifdef NODE_POOL_HAS_PMR
+template<class U>
+inline bool is_monotonic(const std::pmr::polymorphic_allocator<U>& allocator) {
+  return dynamic_cast<std::pmr::monotonic_buffer_resource*>(allocator.resource()) != nullptr;
+}
+#endif
+
+/**
+ * A slab allocator for objects of a single type, intended for the nodes of
+ * linked data structures. Storage is carved out of chunks that grow
+ * geometrically in size; released objects are threaded onto an intrusive free
+ * list and handed out again by subsequent allocations, so that a structure
+ * with a stable population makes no calls to the system allocator. Objects
+ * allocated back to back are adjacent in memory.
+ * <p>
+ * Chunks are obtained from an allocator of type Allocator, rebound as needed,
+ * so that nodes may live in an arena such as a std::pmr::memory_resource; see
+ * {@link PmrNodePool}. Destroying the pool frees every chunk in time linear in
+ * the number of chunks, or in constant time if the allocator is monotonic, in
+ * which case the chunks are reclaimed with the arena. The pool does not track
+ * live objects: destructors of objects still allocated at that point are not
+ * run, which is left to the owner when the object type is not trivially
+ * destructible.
+ *
+ * @author Kevin L. Stern
+ */
+template<class T, class Allocator = std::allocator<T>>
+class NodePool {
+public:
+  typedef Allocator allocator_type;
+
+  static const size_t INITIAL_CHUNK_CAPACITY = 32;
+  static const size_t MAX_CHUNK_CAPACITY = 4096;
+
+  explicit NodePool(const Allocator& allocator = Allocator()) : allocator_(allocator),
+      chunks_(nullptr), free_(nullptr), next_(nullptr), end_(nullptr),
+      chunk_capacity_(INITIAL_CHUNK_CAPACITY), live_(0), capacity_(0) {}
+
+  NodePool(const NodePool&) = delete;
+  NodePool& operator=(const NodePool&) = delete;
+
+  ~NodePool() {
+    if (monotonic()) {
+      return;
+    }
+    while (chunks_ != nullptr) {
+      Chunk* next = chunks_->next;
+      allocator_.deallocate(reinterpret_cast<Slot*>(chunks_), chunks_->slots);
+      chunks_ = next;
+    }
+  }
+
+  /**
+   * Construct a new object from the specified arguments in storage owned by
+   * this pool.
+   */
+  template<class... Args>
+  T* allocate(Args&&... args) {
+    Slot* slot = take_slot();
+    try {
+      T* result = new (slot->storage) T(std::forward<Args>(args)...);
+      ++live_;
+      return result;
+    } catch (...) {
+      slot->next = free_;
+      free_ = slot;
+      throw;
+    }
+  }
+
+  /**
+   * Destroy the specified object, which must have been allocated by this pool,
+   * and make its storage available to subsequent allocations.
+   */
+  void release(T* object) {
+    object->~T();
+    Slot* slot = reinterpret_cast<Slot*>(object);
+    slot->next = free_;
+    free_ = slot;
+    --live_;
+  }
+
+  /**
+   * Ensure that the next count allocations which are not served from the free
+   * list are carved out of a single contiguous block.
+   */
+  void reserve(size_t count) {
+    if (static_cast<size_t>(end_ - next_) < count) {
+      add_chunk(count);
+    }
+  }
+
+  /**
+   * Take over the storage of the specified pool, including the objects still
+   * allocated from it, which may then be released to this pool. The other pool
+   * is left empty. Runs in time linear in the number of chunks and released
+   * objects of the other pool. Storage can change hands only between pools
+   * whose allocators compare equal.
+   *
+   * @return true if the storage was taken over, false if the allocators differ.
+   */
+  bool absorb(NodePool& other) {
+    if (&other == this || other.chunks_ == nullptr) {
+      return true;
+    }
+    if (!(allocator_ == other.allocator_)) {
+      return false;
+    }
+    Chunk* last_chunk = other.chunks_;
+    while (last_chunk->next != nullptr) {
+      last_chunk = last_chunk->next;
+    }
+    last_chunk->next = chunks_;
+    chunks_ = other.chunks_;
+    while (other.next_ != other.end_) {
+      Slot* slot = other.next_++;
+      slot->next = free_;
+      free_ = slot;
+    }
+    while (other.free_ != nullptr) {
+      Slot* slot = other.free_;
+      other.free_ = slot->next;
+      slot->next = free_;
+      free_ = slot;
+    }
+    live_ += other.live_;
+    capacity_ += other.capacity_;
+    other.chunks_ = nullptr;
+    other.next_ = nullptr;
+    other.end_ = nullptr;
+    other.live_ = 0;
+    other.capacity_ = 0;
+    return true;
+  }
+
+  /**
+   * Objects of this pool never move, so pointers to them need no tracking; see
+   * {@link CompactNodePool#track}.
+   */
+  void track(T**) {}
+
+  void untrack(T**) {}
+
+  /**
+   * @return true if the allocator of this pool is monotonic, so that storage
+   *         need not be handed back to it; see {@link is_monotonic}.
+   */
+  bool monotonic() const {
+    return is_monotonic(allocator_);
+  }
+
+  allocator_type get_allocator() const {
+    return allocator_type(allocator_);
+  }
+
+  /**
+   * @return the number of objects currently allocated from this pool.
+   */
+  size_t size() const {
+    return live_;
+  }
+
+  /**
+   * @return the number of objects that fit in the chunks owned by this pool.
+   */
+  size_t capacity() const {
+    return capacity_;
+  }
+
+private:
+  union Slot {
+    Slot* next;
+    alignas(T) unsigned char storage[sizeof(T)];
+  };
+
+  struct alignas(Slot) Chunk {
+    Chunk* next;
+    size_t slots;
+  };
+
+  typedef typename std::allocator_traits<Allocator>::template rebind_alloc<Slot> SlotAllocator;
+
+  // The number of slots taken up by the header of a chunk.
+  static const size_t HEADER_SLOTS = (sizeof(Chunk) + sizeof(Slot) - 1) / sizeof(Slot);
+
+  SlotAllocator allocator_;
+  Chunk* chunks_;
+  Slot* free_;
+  Slot* next_;
+  Slot* end_;
+  size_t chunk_capacity_;
+  size_t live_;
+  size_t capacity_;
+
+  inline Slot* take_slot() {
+    Slot* slot = free_;
+    if (slot != nullptr) {
+      free_ = slot->next;
+      return slot;
+    }
+    if (next_ == end_) {
+      add_chunk(chunk_capacity_);
+      if (chunk_capacity_ < MAX_CHUNK_CAPACITY) {
+        chunk_capacity_ *= 2;
+      }
+    }
+    return next_++;
+  }
+
+  void add_chunk(size_t count) {
+    // Any remainder of the current chunk goes onto the free list.
+    while (next_ != end_) {
+      Slot* slot = next_++;
+      slot->next = free_;
+      free_ = slot;
+    }
+    Slot* memory = allocator_.allocate(HEADER_SLOTS + count);
+    Chunk* chunk = new (memory) Chunk;
+    chunk->next = chunks_;
+    chunk->slots = HEADER_SLOTS + count;
+    chunks_ = chunk;
+    next_ = memory + HEADER_SLOTS;
+    end_ = next_ + count;
+    capacity_ += count;
+  }
+};
+
+#ifdef NODE_POOL_HAS_PMR
+/**
+ * A NodePool drawing its chunks from a std::pmr::memory_resource, such as a
+ * per-request std::pmr::monotonic_buffer_resource, so that the storage of a
+ * tree is reclaimed by releasing the resource.
+ */
+template<class T>
+using PmrNodePool = NodePool<T, std::pmr::polymorphic_allocator<T>>;
+#endif
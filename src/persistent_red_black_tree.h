@@ -0,0 +1,460 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "red_black_tree.h"
+
+template<class T>
+class PersistentNode;
+
+/**
+ * A persistent red-black tree: copying a tree takes constant time, after which
+ * the copies share all of their nodes and may be modified independently.
+ * Modifications copy only the nodes on the path they change (path copying);
+ * nodes are reference counted by the nodes and trees that point to them and
+ * are never modified while shared, so that a copy taken with snapshot() stays
+ * readable, without locks, from any thread while the original is modified. A
+ * node that is not shared with any other version is modified in place, so
+ * that a tree with no outstanding snapshots allocates no more than an
+ * ordinary tree.
+ * <p>
+ * Distinct trees may be used from distinct threads, whether or not they share
+ * nodes; a single tree, as usual, must not be modified concurrently with
+ * other uses of that same tree.
+ * <p>
+ * Nodes carry no parent links, which path copying could not maintain, so this
+ * implementation uses the recursive left-leaning variant of the red-black tree
+ * rather than the bottom-up algorithms of {@link RedBlackTree}. The Compare
+ * parameter is as for {@link RedBlackTree}.
+ *
+ * @see Sedgewick. Left-leaning Red-Black Trees. 2008.
+ * @see Driscoll, Sarnak, Sleator and Tarjan. Making Data Structures
+ *      Persistent. Journal of Computer and System Sciences 38(1), 1989.
+ */
+template<class T, class Compare = int (*)(const T&, const T&)>
+class PersistentRedBlackTree {
+public:
+  typedef PersistentNode<T> NodeType;
+
+  explicit PersistentRedBlackTree(const Compare& compare = Compare())
+      : compare_(compare), root_(nullptr), size_(0) {}
+
+  /**
+   * Copy constructor. Runs in constant time; the copies share their nodes.
+   */
+  PersistentRedBlackTree(const PersistentRedBlackTree& other)
+      : compare_(other.compare_), root_(acquire(other.root_)), size_(other.size_) {}
+
+  PersistentRedBlackTree(PersistentRedBlackTree&& other)
+      : compare_(other.compare_), root_(other.root_), size_(other.size_) {
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+
+  PersistentRedBlackTree& operator=(const PersistentRedBlackTree& other) {
+    NodeType* root = acquire(other.root_);
+    release(root_);
+    compare_ = other.compare_;
+    root_ = root;
+    size_ = other.size_;
+    return *this;
+  }
+
+  PersistentRedBlackTree& operator=(PersistentRedBlackTree&& other) {
+    if (this != &other) {
+      release(root_);
+      compare_ = other.compare_;
+      root_ = other.root_;
+      size_ = other.size_;
+      other.root_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  ~PersistentRedBlackTree() {
+    release(root_);
+  }
+
+  /**
+   * Get a point-in-time copy of this tree, which is unaffected by subsequent
+   * modifications of this tree. Runs in constant time.
+   */
+  PersistentRedBlackTree snapshot() const {
+    return *this;
+  }
+
+  /**
+   * Insert the specified value into this tree.
+   *
+   * @param value
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
+   */
+  bool insert(const T& value) {
+    if (contains(value)) {
+      return false;
+    }
+    root_ = insert(own(root_), value);
+    root_->color_ = BLACK;
+    ++size_;
+    return true;
+  }
+
+  /**
+   * Remove the specified value from this tree.
+   *
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
+   */
+  bool remove(const T& value) {
+    if (!contains(value)) {
+      return false;
+    }
+    root_ = own(root_);
+    if (!is_red(root_->left_) && !is_red(root_->right_)) {
+      root_->color_ = RED;
+    }
+    root_ = remove(root_, value);
+    if (root_ != nullptr) {
+      root_->color_ = BLACK;
+    }
+    --size_;
+    return true;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+  const NodeType* root() const {
+    return root_;
+  }
+
+  /**
+   * Get the node that stores the specified value.
+   *
+   * @param value
+   *            the query value.
+   * @return the node that stores the specified value, null if none.
+   */
+  template<class K>
+  const NodeType* node(const K& value) const {
+    const NodeType* node = root_;
+    while (node != nullptr) {
+      int delta = three_way_compare(compare_, node->value(), value);
+      if (delta < 0) {
+        node = node->right();
+      } else if (delta > 0) {
+        node = node->left();
+      } else {
+        break;
+      }
+    }
+    return node;
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  template<class K>
+  bool contains(const K& value) const {
+    return node(value) != nullptr;
+  }
+
+  /**
+   * Apply the specified function to each value of this tree, in order.
+   */
+  template<class Function>
+  void for_each(Function function) const {
+    for_each(root_, function);
+  }
+
+  /**
+   * Apply the specified function to each value v of this tree with lo <= v <=
+   * hi, in order. Runs in time O(log n + k), where k is the number of such
+   * values.
+   */
+  template<class K, class Function>
+  void for_each_in_range(const K& lo, const K& hi, Function function) const {
+    for_each_in_range(root_, lo, hi, function);
+  }
+
+private:
+  Compare compare_;
+  NodeType* root_;
+  uint32_t size_;
+
+  static NodeType* acquire(NodeType* node) {
+    if (node != nullptr) {
+      node->references_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return node;
+  }
+
+  /**
+   * Drop a reference to the specified node, freeing it, and in turn dropping
+   * its references to its children, when it was the last.
+   */
+  static void release(NodeType* node) {
+    while (node != nullptr
+        && node->references_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      release(node->left_);
+      NodeType* right = node->right_;
+      delete node;
+      node = right;
+    }
+  }
+
+  /**
+   * Get a node that may be modified in place of the specified node, which is
+   * referenced once by the caller: the node itself if it is not shared with
+   * another version, and otherwise a copy that takes over the caller's
+   * reference.
+   */
+  static NodeType* own(NodeType* node) {
+    if (node == nullptr || node->references_.load(std::memory_order_acquire) == 1) {
+      return node;
+    }
+    NodeType* copy = new NodeType(*node);
+    acquire(copy->left_);
+    acquire(copy->right_);
+    release(node);
+    return copy;
+  }
+
+  static NodeType* own_left(NodeType* node) {
+    node->left_ = own(node->left_);
+    return node->left_;
+  }
+
+  static NodeType* own_right(NodeType* node) {
+    node->right_ = own(node->right_);
+    return node->right_;
+  }
+
+  static inline bool is_red(const NodeType* node) {
+    return node != nullptr && node->color_ == RED;
+  }
+
+  // The following operations take and return nodes owned by the caller.
+
+  static NodeType* rotate_left(NodeType* node) {
+    NodeType* temp = own_right(node);
+    node->right_ = temp->left_;
+    temp->left_ = node;
+    temp->color_ = node->color_;
+    node->color_ = RED;
+    return temp;
+  }
+
+  static NodeType* rotate_right(NodeType* node) {
+    NodeType* temp = own_left(node);
+    node->left_ = temp->right_;
+    temp->right_ = node;
+    temp->color_ = node->color_;
+    node->color_ = RED;
+    return temp;
+  }
+
+  static void flip_colors(NodeType* node) {
+    NodeType* left = own_left(node);
+    NodeType* right = own_right(node);
+    node->color_ = node->color_ == RED ? BLACK : RED;
+    left->color_ = left->color_ == RED ? BLACK : RED;
+    right->color_ = right->color_ == RED ? BLACK : RED;
+  }
+
+  static NodeType* balance(NodeType* node) {
+    if (is_red(node->right_) && !is_red(node->left_)) {
+      node = rotate_left(node);
+    }
+    if (is_red(node->left_) && is_red(node->left_->left_)) {
+      node = rotate_right(node);
+    }
+    if (is_red(node->left_) && is_red(node->right_)) {
+      flip_colors(node);
+    }
+    return node;
+  }
+
+  static NodeType* move_red_left(NodeType* node) {
+    flip_colors(node);
+    if (is_red(node->right_->left_)) {
+      node->right_ = rotate_right(node->right_);
+      node = rotate_left(node);
+      flip_colors(node);
+    }
+    return node;
+  }
+
+  static NodeType* move_red_right(NodeType* node) {
+    flip_colors(node);
+    if (is_red(node->left_->left_)) {
+      node = rotate_right(node);
+      flip_colors(node);
+    }
+    return node;
+  }
+
+  /**
+   * Insert the specified value, which is not an element, into the subtree
+   * rooted at the specified node.
+   */
+  NodeType* insert(NodeType* node, const T& value) {
+    if (node == nullptr) {
+      return new NodeType(value);
+    }
+    if (three_way_compare(compare_, node->value_, value) > 0) {
+      node->left_ = insert(own(node->left_), value);
+    } else {
+      node->right_ = insert(own(node->right_), value);
+    }
+    return balance(node);
+  }
+
+  /**
+   * Remove the specified value, which is an element, from the subtree rooted at
+   * the specified node.
+   */
+  NodeType* remove(NodeType* node, const T& value) {
+    if (three_way_compare(compare_, node->value_, value) > 0) {
+      if (!is_red(node->left_) && !is_red(node->left_->left_)) {
+        node = move_red_left(node);
+      }
+      node->left_ = remove(own(node->left_), value);
+    } else {
+      if (is_red(node->left_)) {
+        node = rotate_right(node);
+      }
+      if (node->right_ == nullptr && three_way_compare(compare_, node->value_, value) == 0) {
+        release(node);
+        return nullptr;
+      }
+      if (!is_red(node->right_) && !is_red(node->right_->left_)) {
+        node = move_red_right(node);
+      }
+      if (three_way_compare(compare_, node->value_, value) == 0) {
+        const NodeType* min = node->right_;
+        while (min->left_ != nullptr) {
+          min = min->left_;
+        }
+        node->value_ = min->value_;
+        node->right_ = remove_min(own(node->right_));
+      } else {
+        node->right_ = remove(own(node->right_), value);
+      }
+    }
+    return balance(node);
+  }
+
+  static NodeType* remove_min(NodeType* node) {
+    if (node->left_ == nullptr) {
+      release(node);
+      return nullptr;
+    }
+    if (!is_red(node->left_) && !is_red(node->left_->left_)) {
+      node = move_red_left(node);
+    }
+    node->left_ = remove_min(own(node->left_));
+    return balance(node);
+  }
+
+  template<class K, class Function>
+  void for_each_in_range(const NodeType* node, const K& lo, const K& hi,
+      Function& function) const {
+    while (node != nullptr) {
+      if (three_way_compare(compare_, node->value_, lo) < 0) {
+        node = node->right_;
+      } else if (three_way_compare(compare_, node->value_, hi) > 0) {
+        node = node->left_;
+      } else {
+        for_each_in_range(node->left_, lo, hi, function);
+        function(node->value_);
+        node = node->right_;
+      }
+    }
+  }
+
+  template<class Function>
+  static void for_each(const NodeType* node, Function& function) {
+    while (node != nullptr) {
+      for_each(node->left_, function);
+      function(node->value_);
+      node = node->right_;
+    }
+  }
+};
+
+/**
+ * A node of a {@link PersistentRedBlackTree}. Nodes are immutable once shared
+ * between versions of a tree.
+ */
+template<class T>
+class PersistentNode {
+public:
+  explicit PersistentNode(const T& value) : references_(1), color_(RED), left_(nullptr),
+      right_(nullptr), value_(value) {}
+
+  PersistentNode(const PersistentNode& that) : references_(1), color_(that.color_),
+      left_(that.left_), right_(that.right_), value_(that.value_) {}
+
+  NodeColor color() const {
+    return color_;
+  }
+
+  const PersistentNode* left() const {
+    return left_;
+  }
+
+  const PersistentNode* right() const {
+    return right_;
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+  bool is_leaf() const {
+    return left_ == nullptr && right_ == nullptr;
+  }
+
+private:
+  std::atomic<uint32_t> references_;
+  NodeColor color_;
+  PersistentNode* left_;
+  PersistentNode* right_;
+  T value_;
+
+  PersistentNode& operator=(const PersistentNode&) = delete;
+
+  template<class, class>
+  friend class PersistentRedBlackTree;
+};
@@ -0,0 +1,292 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include "red_black_tree.h"
+
+/**
+ * An entry of a {@link RedBlackMap}: a key, which determines the position of
+ * the entry and so may not change, and a mapped value, which may be modified
+ * in place.
+ */
+template<class K, class V>
+struct MapEntry {
+  const K first;
+  V second;
+
+  template<class... Args>
+  explicit MapEntry(const K& key, Args&&... args)
+      : first(key), second(std::forward<Args>(args)...) {}
+};
+
+/**
+ * Orders map entries by key with a key comparator, and compares entries with
+ * bare keys so that lookups need not construct an entry.
+ */
+template<class K, class V, class KeyCompare>
+struct MapEntryCompare {
+  typedef void is_transparent;
+
+  KeyCompare compare;
+
+  explicit MapEntryCompare(const KeyCompare& compare = KeyCompare()) : compare(compare) {}
+
+  int operator()(const MapEntry<K, V>& a, const MapEntry<K, V>& b) const {
+    return three_way_compare(compare, a.first, b.first);
+  }
+
+  int operator()(const MapEntry<K, V>& a, const K& b) const {
+    return three_way_compare(compare, a.first, b);
+  }
+
+  int operator()(const K& a, const MapEntry<K, V>& b) const {
+    return three_way_compare(compare, a, b.first);
+  }
+
+  int operator()(const K& a, const K& b) const {
+    return three_way_compare(compare, a, b);
+  }
+};
+
+/**
+ * An ordered map from keys to values on a {@link RedBlackTree} of {@link
+ * MapEntry}s. Mapped values are modified in place, through operator[],
+ * insert_or_assign or an iterator, at the cost of a single search and without
+ * rebalancing; only inserting and erasing keys changes the shape of the tree.
+ * <p>
+ * KeyCompare is three-way or two-way, as for RedBlackTree, and NodeTemplate is
+ * the node type, such as {@link Node} or {@link LinkedNode}, applied to the
+ * entry type.
+ */
+template<class K, class V, class KeyCompare = std::less<K>,
+    template<class> class NodeTemplate = Node>
+class RedBlackMap {
+public:
+  typedef MapEntry<K, V> Entry;
+  typedef NodeTemplate<Entry> NodeType;
+  typedef RedBlackTree<Entry, NodeType, MapEntryCompare<K, V, KeyCompare>> Tree;
+  typedef typename Tree::const_iterator const_iterator;
+
+  /**
+   * An iterator over the entries of a map that gives mutable access to their
+   * mapped values; the key of an entry is const. It converts to a
+   * const_iterator.
+   */
+  class iterator {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef Entry value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Entry* pointer;
+    typedef Entry& reference;
+
+    iterator() {}
+
+    reference operator*() const {
+      return entry(position_.node());
+    }
+
+    pointer operator->() const {
+      return &entry(position_.node());
+    }
+
+    iterator& operator++() {
+      ++position_;
+      return *this;
+    }
+
+    iterator operator++(int) {
+      iterator result = *this;
+      ++position_;
+      return result;
+    }
+
+    iterator& operator--() {
+      --position_;
+      return *this;
+    }
+
+    iterator operator--(int) {
+      iterator result = *this;
+      --position_;
+      return result;
+    }
+
+    bool operator==(const iterator& other) const {
+      return position_ == other.position_;
+    }
+
+    bool operator!=(const iterator& other) const {
+      return position_ != other.position_;
+    }
+
+    operator const_iterator() const {
+      return position_;
+    }
+
+  private:
+    const_iterator position_;
+
+    explicit iterator(const const_iterator& position) : position_(position) {}
+
+    friend class RedBlackMap;
+  };
+
+  explicit RedBlackMap(const KeyCompare& compare = KeyCompare())
+      : tree_(MapEntryCompare<K, V, KeyCompare>(compare)) {}
+
+  /**
+   * Get the value mapped to the specified key, mapping a value-initialized V
+   * to it first if there is none.
+   */
+  V& operator[](const K& key) {
+    return try_emplace(key).first->second;
+  }
+
+  /**
+   * Get the value mapped to the specified key.
+   *
+   * @throws std::out_of_range if no value is mapped to key.
+   */
+  V& at(const K& key) {
+    return entry(checked_node(key)).second;
+  }
+
+  const V& at(const K& key) const {
+    return checked_node(key)->value().second;
+  }
+
+  /**
+   * Map a value constructed from the specified arguments to the specified key
+   * if no value is mapped to it, constructing nothing otherwise.
+   *
+   * @return an iterator to the entry of key and whether it was inserted.
+   */
+  template<class... Args>
+  std::pair<iterator, bool> try_emplace(const K& key, Args&&... args) {
+    std::pair<NodeType*, bool> result = tree_.try_emplace(key, key, std::forward<Args>(args)...);
+    return std::make_pair(iterator(tree_.iterator_to(result.first)), result.second);
+  }
+
+  /**
+   * Map the specified value to the specified key, replacing the value mapped
+   * to it if there is one.
+   *
+   * @return an iterator to the entry of key and whether it was inserted.
+   */
+  template<class M>
+  std::pair<iterator, bool> insert_or_assign(const K& key, M&& value) {
+    std::pair<NodeType*, bool> result = tree_.try_emplace(key, key, std::forward<M>(value));
+    if (!result.second) {
+      entry(result.first).second = std::forward<M>(value);
+    }
+    return std::make_pair(iterator(tree_.iterator_to(result.first)), result.second);
+  }
+
+  /**
+   * Remove the entry of the specified key.
+   *
+   * @return true if an entry was removed, false otherwise.
+   */
+  bool erase(const K& key) {
+    const NodeType* node = tree_.node(key);
+    if (node == nullptr) {
+      return false;
+    }
+    tree_.extract(node);
+    return true;
+  }
+
+  iterator find(const K& key) {
+    return iterator(tree_.iterator_to(tree_.node(key)));
+  }
+
+  const_iterator find(const K& key) const {
+    return tree_.iterator_to(tree_.node(key));
+  }
+
+  bool contains(const K& key) const {
+    return tree_.contains(key);
+  }
+
+  const_iterator lower_bound(const K& key) const {
+    return tree_.lower_bound(key);
+  }
+
+  const_iterator upper_bound(const K& key) const {
+    return tree_.upper_bound(key);
+  }
+
+  iterator begin() {
+    return iterator(tree_.begin());
+  }
+
+  iterator end() {
+    return iterator(tree_.end());
+  }
+
+  const_iterator begin() const {
+    return tree_.begin();
+  }
+
+  const_iterator end() const {
+    return tree_.end();
+  }
+
+  uint32_t size() const {
+    return tree_.size();
+  }
+
+  bool empty() const {
+    return tree_.size() == 0;
+  }
+
+  void clear() {
+    tree_.clear();
+  }
+
+private:
+  Tree tree_;
+
+  /**
+   * Get mutable access to the entry of the specified node. The tree hands out
+   * its values as const since they determine the order, but the key of an
+   * entry is const itself, so only the mapped value becomes modifiable.
+   */
+  static Entry& entry(const NodeType* node) {
+    return const_cast<Entry&>(node->value());
+  }
+
+  const NodeType* checked_node(const K& key) const {
+    const NodeType* node = tree_.node(key);
+    if (node == nullptr) {
+      throw std::out_of_range("key not found");
+    }
+    return node;
+  }
+};
@@ -20,9 +20,20 @@
  */
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <future>
+#include <iosfwd>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-#include <queue>
+#include "node_pool.h"
 
 /**
  * red_black_tree.h
@@ -35,6 +46,37 @@
  * This implementation is based upon Cormen, Leiserson, Rivest, Stein's
  * Introduction to Algorithms book.
  *
+ * <p>
+ * Nodes are obtained from a pool, a {@link NodePool} by default, so that
+ * insertions and removals do not reach the system allocator in the steady
+ * state and tearing down a tree releases its storage in bulk. A pool type
+ * provides allocate(args...) constructing a node and release(node) destroying
+ * it. Trees that share a pool, such as the two halves of a split, may pass
+ * nodes to one another without copying; such trees must not be modified
+ * concurrently. A pool may also move its nodes as it grows, as a
+ * {@link CompactNodePool} does, provided that it rebases the pointers
+ * registered with track(&pointer); a tree registers its root and its least and
+ * greatest nodes, and pointers to
+ * nodes held outside the tree are then invalidated by insertions.
+ * <p>
+ * Values are ordered by a comparator of type Compare, which is either
+ * three-way, returning a negative, zero or positive int as its first argument
+ * is less than, equal to or greater than its second, or two-way in the style
+ * of std::less, returning whether its first argument is less than its second.
+ * The comparator is a template parameter so that calls to a function object or
+ * lambda can be inlined into the search loops. If Compare defines
+ * is_transparent, lookups accept keys of any type that it can compare against
+ * T.
+ * <p>
+ * The node type selects optional capabilities: {@link Node} is the plain node,
+ * {@link LinkedNode} additionally threads nodes in order so that successor and
+ * predecessor take constant time, {@link OrderStatisticNode} maintains
+ * subtree sizes so that select, rank and count_range take logarithmic time,
+ * {@link AugmentedNode} maintains an aggregate of each subtree's values under
+ * an associative operation so that aggregate takes logarithmic time, and
+ * {@link MultiNode} counts the occurrences of its value, making the tree a
+ * multiset.
+ *
  * @see Introduction to Algorithms Cormen, Leiserson, Rivest, and Stein.
  *      Introduction to Algorithms. 2nd ed. Cambridge, MA: MIT Press, 2001.
  *      ISBN: 0262032937.
@@ -43,280 +85,1344 @@ enum NodeColor {
   RED, BLACK
 };
 
+template<class Compare, class A, class B>
+inline int three_way_compare(const Compare& compare, const A& a, const B& b,
+    std::false_type /* three_way */) {
+  return compare(a, b);
+}
+
+template<class Compare, class A, class B>
+inline int three_way_compare(const Compare& compare, const A& a, const B& b,
+    std::true_type /* two_way */) {
+  return compare(a, b) ? -1 : (compare(b, a) ? 1 : 0);
+}
+
+/**
+ * Three-way comparison of the specified operands in terms of the specified
+ * comparator, which may itself be three-way or two-way.
+ */
+template<class Compare, class A, class B>
+inline int three_way_compare(const Compare& compare, const A& a, const B& b) {
+  return three_way_compare(compare, a, b, std::integral_constant<bool,
+      std::is_same<decltype(compare(a, b)), bool>::value>());
+}
+
+/**
+ * Counts of the basic operations performed by a {@link RedBlackTree} since its
+ * construction, kept only if RED_BLACK_TREE_COUNTERS is defined when the tree
+ * is compiled, and otherwise zero. The macro must be defined consistently
+ * across a program.
+ */
+struct RedBlackTreeCounters {
+  uint64_t comparisons;
+  uint64_t rotations;
+  // Changes of color made by rebalancing.
+  uint64_t recolorings;
+  // Iterations of the rebalancing loops after insertion and removal.
+  uint64_t fixup_iterations;
+  uint64_t allocations;
+};
+
+/**
+ * The shape and footprint of a {@link RedBlackTree}, as reported by {@link
+ * RedBlackTree#stats}.
+ */
+struct RedBlackTreeStats {
+  uint32_t size;
+  // The number of nodes on the longest path from the root to a leaf.
+  uint32_t height;
+  // The number of black nodes on every path from the root to a leaf.
+  uint32_t black_height;
+  // The bytes taken up by the nodes of the tree.
+  size_t node_bytes;
+  // The bytes of node storage held by the pool of the tree, which may be
+  // shared with other trees.
+  size_t pool_bytes;
+  RedBlackTreeCounters counters;
+};
+
+// Bump an operation counter of the tree; undefined at the end of this header.
+#ifdef RED_BLACK_TREE_COUNTERS
+#define RED_BLACK_TREE_COUNT(counter) counters_.tally(OperationCounters::counter)
+#else
+#define RED_BLACK_TREE_COUNT(counter) ((void) 0)
+#endif
+
 template<class T>
 class Node;
 
 template<class T>
 class LinkedNode;
 
-template<class T, class NodeType>
+template<class T>
+class OrderStatisticNode;
+
+template<class T, class Policy>
+class AugmentedNode;
+
+template<class T>
+class MultiNode;
+
+template<class T, class Compare = int (*)(const T&, const T&)>
+class FrozenRedBlackTree;
+
+template<class T, class NodeType, class Compare = int (*)(const T&, const T&),
+    class Pool = NodePool<NodeType>>
 class RedBlackTree {
 public:
-  RedBlackTree(int (*compare)(const T&, const T&)) : compare_(compare), root_(nullptr), size_(0) {}
+  /**
+   * An in-order iterator over the values of a RedBlackTree. Advancing takes
+   * constant time with {@link LinkedNode} and amortized constant time
+   * otherwise. Insertions leave iterators valid unless the pool moves its
+   * nodes, and removing a value invalidates only iterators to it.
+   */
+  class const_iterator {
+  public:
+    typedef std::bidirectional_iterator_tag iterator_category;
+    typedef T value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const T* pointer;
+    typedef const T& reference;
+
+    const_iterator() : tree_(nullptr), node_(nullptr) {}
+
+    reference operator*() const {
+      return node_->value();
+    }
 
-  ~RedBlackTree() {
-    std::queue<NodeType*> q;
-    if (root_ != nullptr) {
-      q.push(root_);
+    pointer operator->() const {
+      return &node_->value();
     }
-    while (q.size() > 0) {
-      NodeType* node = q.front();
-      q.pop();
-      if (node->left() != nullptr) {
-        q.push(node->left());
-      }
-      if (node->right() != nullptr) {
-        q.push(node->right());
-      }
-      delete node;
+
+    const_iterator& operator++() {
+      node_ = tree_->successor(node_);
+      return *this;
+    }
+
+    const_iterator operator++(int) {
+      const_iterator result = *this;
+      ++*this;
+      return result;
+    }
+
+    const_iterator& operator--() {
+      node_ = node_ == nullptr ? tree_->last_node() : tree_->predecessor(node_);
+      return *this;
+    }
+
+    const_iterator operator--(int) {
+      const_iterator result = *this;
+      --*this;
+      return result;
+    }
+
+    bool operator==(const const_iterator& other) const {
+      return node_ == other.node_;
+    }
+
+    bool operator!=(const const_iterator& other) const {
+      return node_ != other.node_;
+    }
+
+    /**
+     * @return the node at which this iterator points, null at the end.
+     */
+    const NodeType* node() const {
+      return node_;
     }
-  }
+
+  private:
+    const RedBlackTree* tree_;
+    const NodeType* node_;
+
+    const_iterator(const RedBlackTree* tree, const NodeType* node) : tree_(tree), node_(node) {}
+
+    friend class RedBlackTree;
+  };
 
   /**
-   * Insert the specified value into this tree.
-   *
-   * @param value
-   *            the value to insert.
-   * @return true if the value was inserted to this tree, false otherwise.
+   * Owner of a node extracted from a tree by {@link RedBlackTree#extract},
+   * through which the value may be modified or moved out before the node is
+   * inserted into a tree again. A handle that still owns a node when destroyed
+   * releases it to its pool.
    */
-  bool insert(const T& value) {
-    NodeType* node = nullptr;
-    NodeType* parent = root_;
-    while (parent != nullptr) {
-      int delta = compare_(parent->value(), value);
-      if (delta < 0) {
-        if (parent->right() == nullptr) {
-          node = new NodeType(value);
-          parent->set_right(node);
-          node->set_parent(parent);
-          parent = nullptr;
-        } else {
-          parent = parent->right();
-        }
-      } else if (delta > 0) {
-        if (parent->left() == nullptr) {
-          node = new NodeType(value);
-          parent->set_left(node);
-          node->set_parent(parent);
-          parent = nullptr;
-        } else {
-          parent = parent->left();
-        }
-      } else {
-        return false;
+  class NodeHandle {
+  public:
+    NodeHandle() : node_(nullptr) {}
+
+    NodeHandle(NodeHandle&& other) : pool_(other.pool_), node_(other.node_) {
+      if (pool_ != nullptr) {
+        pool_->track(&node_);
       }
+      other.reset(false);
     }
-    if (node == nullptr) {
-      node = new NodeType(value);
-      root_ = node;
+
+    NodeHandle& operator=(NodeHandle&& other) {
+      if (this != &other) {
+        reset(true);
+        pool_ = other.pool_;
+        node_ = other.node_;
+        if (pool_ != nullptr) {
+          pool_->track(&node_);
+        }
+        other.reset(false);
+      }
+      return *this;
     }
 
-    set_color(node, RED);
-    fix_after_insertion(node);
-    ++size_;
+    NodeHandle(const NodeHandle&) = delete;
+    NodeHandle& operator=(const NodeHandle&) = delete;
 
-    post_insert(node);
+    ~NodeHandle() {
+      reset(true);
+    }
 
-    return true;
-  }
+    bool empty() const {
+      return node_ == nullptr;
+    }
 
-  /**
-   * Remove the specified value from this tree.
-   *
-   * @param value
-   *            the value to remove.
-   * @return true if the value was removed from this tree, false otherwise.
-   */
-  bool remove(const T& value) {
-    NodeType* node = this->node(value);
-    if (node == nullptr)
-      return false;
-    NodeType* swap;
-    if (!(node->left() == nullptr|| node->right() == nullptr)) {
-      NodeType* successor = this->successor(node);
-      exchange_values(node, successor);
-      node = successor;
+    explicit operator bool() const {
+      return node_ != nullptr;
     }
-    if (node->left() != nullptr) {
-      swap = node->left();
-    } else {
-      swap = node->right();
+
+    /**
+     * @return the value of the extracted node, which must not be empty.
+     */
+    T& value() const {
+      // The node is detached, so its value may change without harm.
+      return const_cast<T&>(node_->value());
     }
-    if (swap != nullptr)
-      swap->set_parent(node->parent());
-    if (node->parent() == nullptr)
-      root_ = swap;
-    else if (node == node->parent()->left())
-      node->parent()->set_left(swap);
-    else
-      node->parent()->set_right(swap);
-    if (node->color() == BLACK) {
-      if (root_ != nullptr)
-        fix_after_removal(swap == nullptr ? node : swap);
+
+  private:
+    std::shared_ptr<Pool> pool_;
+    NodeType* node_;
+
+    NodeHandle(const std::shared_ptr<Pool>& pool, NodeType* node) : pool_(pool), node_(node) {
+      pool_->track(&node_);
     }
 
-    --size_;
+    /**
+     * Give up the node, releasing it to its pool if so specified.
+     */
+    void reset(bool release) {
+      if (pool_ != nullptr) {
+        pool_->untrack(&node_);
+        if (release && node_ != nullptr) {
+          pool_->release(node_);
+        }
+      }
+      pool_.reset();
+      node_ = nullptr;
+    }
 
-    post_delete(node);
+    friend class RedBlackTree;
+  };
 
-    bool result = node != nullptr;
-    delete node;
-    return result;
+  // Values are immutable in place, as their position depends on them.
+  typedef const_iterator iterator;
+  typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+  typedef const_reverse_iterator reverse_iterator;
+
+  explicit RedBlackTree(const Compare& compare = Compare())
+      : compare_(compare), pool_(std::make_shared<Pool>()), root_(nullptr), head_(nullptr),
+        tail_(nullptr), size_(0) {
+    track_anchors();
   }
 
-  uint32_t size() const {
-    return size_;
+  /**
+   * Construct an empty tree that allocates its nodes from the specified pool,
+   * which may be shared with other trees.
+   */
+  RedBlackTree(const Compare& compare, const std::shared_ptr<Pool>& pool)
+      : compare_(compare), pool_(pool), root_(nullptr), head_(nullptr),
+        tail_(nullptr), size_(0) {
+    track_anchors();
   }
 
-  NodeType* first_node() {
-    return get_first_node_impl();
+  /**
+   * Construct an empty tree whose pool obtains its storage from the specified
+   * allocator, such as a std::pmr::polymorphic_allocator; see {@link
+   * PmrRedBlackTree}.
+   */
+  template<class Allocator, class P = Pool,
+      class = typename std::enable_if<std::is_constructible<P, const Allocator&>::value>::type>
+  RedBlackTree(const Compare& compare, const Allocator& allocator)
+      : compare_(compare), pool_(std::make_shared<Pool>(allocator)), root_(nullptr), head_(nullptr),
+        tail_(nullptr), size_(0) {
+    track_anchors();
   }
 
-  const NodeType* first_node() const {
-    return get_first_node_impl();
+  /**
+   * Construct a tree holding the values in the specified range, which must be
+   * sorted in ascending order and free of duplicates. See {@link #assign}.
+   */
+  template<class Iterator>
+  RedBlackTree(Iterator begin, Iterator end, const Compare& compare = Compare())
+      : compare_(compare), pool_(std::make_shared<Pool>()), root_(nullptr), head_(nullptr),
+        tail_(nullptr), size_(0) {
+    track_anchors();
+    assign(begin, end);
   }
 
-  NodeType* last_node() {
-    return get_last_node_impl();
+  RedBlackTree(const RedBlackTree&) = delete;
+  RedBlackTree& operator=(const RedBlackTree&) = delete;
+
+  /**
+   * Move constructor. The moved-from tree is left empty, sharing the pool of
+   * this tree.
+   */
+  RedBlackTree(RedBlackTree&& other)
+      : compare_(other.compare_), pool_(other.pool_), root_(other.root_), head_(other.head_),
+        tail_(other.tail_), size_(other.size_) {
+    track_anchors();
+    other.root_ = nullptr;
+    other.head_ = nullptr;
+    other.tail_ = nullptr;
+    other.size_ = 0;
   }
 
-  const NodeType* last_node() const {
-    return get_last_node_impl();
+  /**
+   * Move assignment operator. The moved-from tree is left empty, sharing the
+   * pool of this tree.
+   */
+  RedBlackTree& operator=(RedBlackTree&& other) {
+    if (this != &other) {
+      clear();
+      compare_ = other.compare_;
+      use_pool(other.pool_);
+      root_ = other.root_;
+      head_ = other.head_;
+      tail_ = other.tail_;
+      size_ = other.size_;
+      other.root_ = nullptr;
+      other.head_ = nullptr;
+      other.tail_ = nullptr;
+      other.size_ = 0;
+    }
+    return *this;
+  }
+
+  ~RedBlackTree() {
+    untrack_anchors();
+    if (pool_.use_count() > 1) {
+      // The pool outlives this tree, so hand the nodes back for reuse.
+      clear();
+    } else if (!std::is_trivially_destructible<NodeType>::value) {
+      dispose_subtree(root_, [](NodeType* node) { node->~NodeType(); });
+    }
   }
 
   /**
-   * Get the node that stores the specified value.
+   * Insert the specified value into this tree. With {@link MultiNode}, an
+   * equivalent value already present has its count incremented instead, which
+   * neither allocates nor rebalances.
    *
    * @param value
-   *            the query value.
-   * @return the node that stores the specified value, null if none.
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
    */
-  NodeType* node(const T& value) {
-    return get_node_impl(value);
+  bool insert(const T& value) {
+    std::pair<NodeType*, bool> result = insert_from(root_, value,
+        [this, &value](NodeType*& parent) { return allocate(parent, value); });
+    return result.second || add_occurrence(result.first);
   }
 
   /**
-   * Get the node that stores the specified value.
+   * Insert the specified value into this tree, moving it into the new node.
+   * The value is left untouched if an equivalent value is already present.
    *
    * @param value
-   *            the query value.
-   * @return the node that stores the specified value, null if none.
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
    */
-  const NodeType* node(const T& value) const {
-    return get_node_impl(value);
+  bool insert(T&& value) {
+    std::pair<NodeType*, bool> result = insert_from(root_, value,
+        [this, &value](NodeType*& parent) { return allocate(parent, std::move(value)); });
+    return result.second || add_occurrence(result.first);
   }
 
-  NodeType* root() {
-    return root_;
+  /**
+   * Insert a value constructed in place from the specified arguments into this
+   * tree. As the value must exist to be compared, a node is constructed first
+   * and released again if an equivalent value is already present.
+   *
+   * @param args
+   *            the arguments with which to construct the value.
+   * @return true if the value was inserted to this tree, false otherwise.
+   */
+  template<class... Args>
+  bool emplace(Args&&... args) {
+    NodeType* node = pool_->allocate(std::forward<Args>(args)...);
+    RED_BLACK_TREE_COUNT(ALLOCATIONS);
+    std::pair<NodeType*, bool> result = insert_from(root_, node->value(),
+        [node](NodeType*&) { return node; });
+    if (!result.second) {
+      pool_->release(node);
+      return add_occurrence(result.first);
+    }
+    return true;
   }
 
-  const NodeType* root() const {
-    return root_;
+  /**
+   * Get the node holding a value equivalent to the specified key, inserting a
+   * node constructed from the specified arguments, which must hold a value
+   * equivalent to key, if there is none. The node is constructed only if it is
+   * inserted, after a single search.
+   *
+   * @param key
+   *            the key of the value.
+   * @param args
+   *            the arguments with which to construct the value.
+   * @return the node holding the value and whether it was inserted.
+   */
+  template<class K, class... Args>
+  std::pair<NodeType*, bool> try_emplace(const K& key, Args&&... args) {
+    return insert_from(root_, key, [&](NodeType*& parent) {
+      return allocate(parent, std::forward<Args>(args)...);
+    });
   }
 
   /**
-   * Get the predecessor of the specified node. The predecessor of a node n is
-   * the node with the largest value in the tree smaller than the value stored
-   * at n.
+   * Insert the node owned by the specified handle into this tree. The node
+   * itself is linked in if it comes from this tree's pool, and otherwise its
+   * value is moved into a new node. With {@link MultiNode}, the occurrences of
+   * the handle's value are added to those of an equivalent value already
+   * present and its node is released. The handle is left empty if the value
+   * was inserted and untouched otherwise.
    *
-   * @see CLRS
+   * @param handle
+   *            the handle of the node to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
    */
-  NodeType* predecessor(NodeType* node) {
-    return predecessor_impl(node);
+  bool insert(NodeHandle&& handle) {
+    if (handle.empty()) {
+      return false;
+    }
+    std::pair<NodeType*, bool> result = insert_from(root_, handle.value(),
+        [this, &handle](NodeType*& parent) {
+      if (handle.pool_ == pool_) {
+        NodeType* node = handle.node_;
+        handle.reset(false);
+        return node;
+      }
+      NodeType* node = allocate(parent, std::move(handle.value()));
+      transfer_occurrences(node, handle.node_);
+      handle.reset(true);
+      return node;
+    });
+    if (!result.second && merge_occurrences(result.first, handle.node_)) {
+      handle.reset(true);
+      return true;
+    }
+    return result.second;
   }
 
   /**
-   * Get the predecessor of the specified node. The predecessor of a node n is
-   * the node with the largest value in the tree smaller than the value stored
-   * at n.
+   * Unlink the specified node from this tree and hand it over to the caller,
+   * without copying, moving or releasing its value. Runs in time O(log n).
    *
-   * @see CLRS
+   * @param node
+   *            a node of this tree.
+   * @return the handle owning the node.
    */
-  const NodeType* predecessor(const NodeType* node) const {
-    return predecessor_impl(node);
+  NodeHandle extract(const NodeType* node) {
+    NodeType* target = const_cast<NodeType*>(node);
+    unlink(target);
+    return NodeHandle(pool_, target);
   }
 
   /**
-   * Get the successor of the specified node. The successor of a node n is the
-   * node with the smallest value in the tree larger than the value stored at n.
+   * Insert the specified value into this tree, searching for its position
+   * outward from the specified hint rather than down from the root. The search
+   * takes time O(log d), where d is the distance in the tree between the hint
+   * and the value, and constant time when the value belongs next to the hint:
+   * passing the iterator returned by each insertion as the hint of the next
+   * thus inserts an ascending or descending run, or a nearly sorted one, in
+   * amortized constant time per value with {@link LinkedNode}. Other node types
+   * climb parent links to find the neighbor of the hint, in time bounded by the
+   * height of the tree but without comparisons.
    *
-   * @see CLRS
+   * @param hint
+   *            an iterator near the position of the value; end() is taken to
+   *            mean after the largest value.
+   * @param value
+   *            the value to insert.
+   * @return an iterator to the inserted value, or to the value already
+   *         present and equivalent to it.
    */
-  NodeType* successor(NodeType* node) {
-    return successor_impl(node);
+  const_iterator insert(const_iterator hint, const T& value) {
+    NodeType* start = root_;
+    if (root_ != nullptr) {
+      NodeType* finger = const_cast<NodeType*>(hint.node());
+      start = search_from(finger == nullptr ? rightmost(root_) : finger, value);
+    }
+    std::pair<NodeType*, bool> result = insert_from(start, value,
+        [this, &value](NodeType*& parent) { return allocate(parent, value); });
+    if (!result.second) {
+      add_occurrence(result.first);
+    }
+    return const_iterator(this, result.first);
   }
 
   /**
-   * Get the successor of the specified node. The successor of a node n is the
-   * node with the smallest value in the tree larger than the value stored at n.
+   * Remove the specified value from this tree.
    *
-   * @see CLRS
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
    */
-  const NodeType* successor(const NodeType* node) const {
-    return successor_impl(node);
+  bool remove(const T& value) {
+    NodeType* node = this->node(value);
+    if (node == nullptr)
+      return false;
+    unlink(node);
+    pool_->release(node);
+    return true;
   }
 
   /**
-   * Test whether or not the specified value is an element of this tree.
+   * @return the number of occurrences of the specified value in this tree,
+   *         which is at most one unless the node type is {@link MultiNode}.
+   */
+  uint32_t count(const T& value) const {
+    const NodeType* node = this->node(value);
+    return node == nullptr ? 0 : occurrences(node);
+  }
+
+  /**
+   * Remove one occurrence of the specified value from this tree. With {@link
+   * MultiNode}, a value occurring more than once has its count decremented,
+   * which neither releases nor rebalances; otherwise the node is removed.
    *
    * @param value
-   *            the query value.
-   * @return true if the specified value is an element of this tree, false
-   *         otherwise.
+   *            the value to remove.
+   * @return true if an occurrence was removed, false otherwise.
    */
-  bool contains(const T& value) const {
-    return node(value) != nullptr;
+  bool erase_one(const T& value) {
+    NodeType* node = this->node(value);
+    if (node == nullptr) {
+      return false;
+    }
+    if (!remove_occurrence(node)) {
+      unlink(node);
+      pool_->release(node);
+    }
+    return true;
   }
 
-protected:
   /**
-   * Perform a right rotate operation on the specified node.
-   *
-   * @param node
-   *            the node on which a right rotate operation is to be performed.
+   * Remove every occurrence of the specified value from this tree.
    *
-   * @see CLRS Introduction to Algorithms
+   * @param value
+   *            the value to remove.
+   * @return the number of occurrences removed.
    */
-  void right_rotate(NodeType* node) {
-    NodeType* temp = node->left();
-    node->set_left(temp->right());
-    if (temp->right() != nullptr)
-      temp->right()->set_parent(node);
-    temp->set_parent(node->parent());
-    if (node->parent() == nullptr)
-      root_ = temp;
-    else if (node == node->parent()->right())
-      node->parent()->set_right(temp);
-    else
-      node->parent()->set_left(temp);
-    temp->set_right(node);
-    node->set_parent(temp);
+  uint32_t erase_all(const T& value) {
+    NodeType* node = this->node(value);
+    if (node == nullptr) {
+      return 0;
+    }
+    uint32_t count = occurrences(node);
+    unlink(node);
+    pool_->release(node);
+    return count;
   }
 
   /**
-   * Perform a left rotate operation on the specified node.
+   * Replace the contents of this tree with the values in the specified range,
+   * which must be sorted in ascending order and free of duplicates. The tree is
+   * built directly in balanced form, without comparisons or rotations, in time
+   * O(n). Nodes are allocated in order, so that a tree built into a pool with
+   * no released storage occupies a single contiguous block laid out in value
+   * order.
    *
-   * @param node
-   *            the node on which the left rotate operation will be performed.
-   *
-   * @see CLRS Introduction to Algorithms
+   * @param begin
+   *            the beginning of the sorted range, a forward iterator.
+   * @param end
+   *            the end of the sorted range.
    */
-  void left_rotate(NodeType* node) {
-    NodeType* temp = node->right();
-    node->set_right(temp->left());
-    if (temp->left() != nullptr)
-      temp->left()->set_parent(node);
-
-    temp->set_parent(node->parent());
-    if (node->parent() == nullptr)
-      root_ = temp;
-    else if (node == node->parent()->left())
-      node->parent()->set_left(temp);
-    else
-      node->parent()->set_right(temp);
-
-    temp->set_left(node);
-    node->set_parent(temp);
+  template<class Iterator>
+  void assign(Iterator begin, Iterator end) {
+    clear();
+    uint32_t count = static_cast<uint32_t>(std::distance(begin, end));
+    if (count == 0) {
+      return;
+    }
+    pool_->reserve(count);
+    auto next_node = [this, &begin]() {
+      NodeType* node = pool_->allocate(*begin);
+      RED_BLACK_TREE_COUNT(ALLOCATIONS);
+      ++begin;
+      return node;
+    };
+    build_tree(next_node, count);
+  }
+
+  /**
+   * Remove every value v of this tree with lo <= v <= hi. The range is split
+   * off and joined around, and its nodes released in a single walk, in time
+   * O(log n + k), where k is the number of values removed.
+   *
+   * @param lo
+   *            the lower bound of the range, inclusive.
+   * @param hi
+   *            the upper bound of the range, inclusive.
+   * @return the number of occurrences removed, as for {@link #erase_all}.
+   */
+  template<class K>
+  uint32_t erase_range(const K& lo, const K& hi) {
+    if (root_ == nullptr || compare(lo, hi) > 0) {
+      return 0;
+    }
+    uint32_t size = size_;
+    Subtree less;
+    Subtree rest;
+    Subtree middle;
+    Subtree greater;
+    NodeType* found_lo = split_subtree(detach(), lo, less, rest);
+    NodeType* found_hi = split_subtree(rest, hi, middle, greater);
+    uint32_t erased = 0;
+    uint32_t erased_occurrences = 0;
+    auto release = [this, &erased, &erased_occurrences](NodeType* node) {
+      erased_occurrences += occurrences(node);
+      pool_->release(node);
+      ++erased;
+    };
+    if (found_lo != nullptr) {
+      release(found_lo);
+    }
+    if (found_hi != nullptr) {
+      release(found_hi);
+    }
+    dispose_subtree(middle.root, release);
+    attach(join_subtrees(less, greater), size - erased);
+    return erased_occurrences;
+  }
+
+  /**
+   * Remove every value of this tree that satisfies the specified predicate.
+   * The tree is swept once in order, and if any value is removed the nodes that
+   * remain are relinked into balanced form, without comparisons, rotations or
+   * allocation, in time O(n).
+   *
+   * @param predicate
+   *            the predicate, called once per value as predicate(value).
+   * @return the number of occurrences removed, as for {@link #erase_all}.
+   */
+  template<class Predicate>
+  uint32_t erase_if(Predicate predicate) {
+    std::vector<NodeType*> kept;
+    std::vector<NodeType*> erased;
+    kept.reserve(size_);
+    for (NodeType* node = leftmost(root_); node != nullptr; node = successor_internal(node)) {
+      (predicate(node->value()) ? erased : kept).push_back(node);
+    }
+    if (erased.empty()) {
+      return 0;
+    }
+    uint32_t erased_occurrences = 0;
+    for (NodeType* node : erased) {
+      erased_occurrences += occurrences(node);
+      pool_->release(node);
+    }
+    root_ = nullptr;
+    size_t j = 0;
+    auto next_node = [&kept, &j]() { return kept[j++]; };
+    build_tree(next_node, static_cast<uint32_t>(kept.size()));
+    return erased_occurrences;
+  }
+
+  /**
+   * Remove all values from this tree.
+   */
+  void clear() {
+    dispose_subtree(root_, [this](NodeType* node) { pool_->release(node); });
+    root_ = nullptr;
+    head_ = nullptr;
+    tail_ = nullptr;
+    size_ = 0;
+  }
+
+  /**
+   * Append the values of the specified tree, all of which must be greater than
+   * every value of this tree, to this tree, leaving the other tree empty. Runs
+   * in time O(log n).
+   *
+   * @param greater
+   *            the tree whose values are to be appended.
+   */
+  void join(RedBlackTree&& greater) {
+    if (&greater == this || greater.root_ == nullptr) {
+      return;
+    }
+    adopt(greater);
+    uint32_t size = size_ + greater.size_;
+    Subtree result = join_subtrees(detach(), greater.detach());
+    attach(result, size);
+  }
+
+  /**
+   * Move every value of this tree that is not less than the specified key into
+   * a new tree, which shares the pool of this tree. Runs in time O(log n) with
+   * {@link OrderStatisticNode} and otherwise in time O(log n + k), where k is
+   * the size of the smaller of the two resulting trees, which must be counted.
+   *
+   * @param key
+   *            the key at which to split.
+   * @return a tree holding the values of this tree not less than key.
+   */
+  template<class K>
+  RedBlackTree split(const K& key) {
+    RedBlackTree result(compare_, pool_);
+    if (root_ == nullptr) {
+      return result;
+    }
+    uint32_t size = size_;
+    Subtree less;
+    Subtree greater;
+    NodeType* found = split_subtree(detach(), key, less, greater);
+    if (found != nullptr) {
+      greater = join_subtrees(Subtree(), found, greater);
+    }
+    uint32_t less_size = count_nodes(less.root, greater.root, size);
+    attach(less, less_size);
+    result.attach(greater, size - less_size);
+    return result;
+  }
+
+  /**
+   * Add the values of the specified tree to this tree, leaving the other tree
+   * empty. Nodes of the other tree are moved rather than copied, and those
+   * holding values already in this tree are released. Runs in time
+   * O(m log(n / m + 1)), where m is the size of the smaller tree.
+   *
+   * @param other
+   *            the tree whose values are to be added.
+   * @param parallelism
+   *            the number of threads among which to divide the work.
+   */
+  void union_with(RedBlackTree&& other, unsigned parallelism = 1) {
+    if (&other == this || other.root_ == nullptr) {
+      return;
+    }
+    adopt(other);
+    uint32_t size = size_ + other.size_;
+    SetOperation operation(fork_depth(parallelism));
+    Subtree result = union_subtrees(detach(), other.detach(), operation);
+    attach(result, size - operation.matches);
+    release_garbage(operation.garbage);
+  }
+
+  /**
+   * Remove from this tree every value that is not an element of the specified
+   * tree. Runs in time O(m log(n / m + 1)), where m is the size of the smaller
+   * tree.
+   *
+   * @param other
+   *            the tree with which to intersect.
+   * @param parallelism
+   *            the number of threads among which to divide the work.
+   */
+  void intersect_with(const RedBlackTree& other, unsigned parallelism = 1) {
+    if (&other == this) {
+      return;
+    }
+    SetOperation operation(fork_depth(parallelism));
+    Subtree result = intersect_subtrees(detach(), other.root_, operation);
+    attach(result, operation.matches);
+    release_garbage(operation.garbage);
+  }
+
+  /**
+   * Remove from this tree every value that is an element of the specified
+   * tree. Runs in time O(m log(n / m + 1)), where m is the size of the smaller
+   * tree.
+   *
+   * @param other
+   *            the tree whose values are to be removed.
+   * @param parallelism
+   *            the number of threads among which to divide the work.
+   */
+  void difference_with(const RedBlackTree& other, unsigned parallelism = 1) {
+    if (&other == this) {
+      clear();
+      return;
+    }
+    uint32_t size = size_;
+    SetOperation operation(fork_depth(parallelism));
+    Subtree result = difference_subtrees(detach(), other.root_, operation);
+    attach(result, size - operation.matches);
+    release_garbage(operation.garbage);
+  }
+
+  /**
+   * Copy the values of this tree into an immutable, search-optimized {@link
+   * FrozenRedBlackTree}, which is defined in frozen_red_black_tree.h. Runs in
+   * time O(n).
+   */
+  FrozenRedBlackTree<T, Compare> freeze() const {
+    return FrozenRedBlackTree<T, Compare>(begin(), end(), compare_);
+  }
+
+  /**
+   * Write a binary image of this tree, for trivially copyable T, to the
+   * specified stream. The image is that of {@link FrozenRedBlackTree#save}, so
+   * that it may also be queried in place with {@link FrozenRedBlackTree#view}.
+   */
+  void save(std::ostream& out) const {
+    freeze().save(out);
+  }
+
+  /**
+   * Replace the contents of this tree with those of the image read from the
+   * specified stream, as written by {@link #save}. The tree is built without
+   * comparisons in time O(n).
+   */
+  void load(std::istream& in) {
+    FrozenRedBlackTree<T, Compare> image = FrozenRedBlackTree<T, Compare>::load(in, compare_);
+    assign(image.begin(), image.end());
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+  /**
+   * Report the shape and footprint of this tree, together with the operation
+   * counts if RED_BLACK_TREE_COUNTERS is defined. Runs in time O(n), as the
+   * height is measured by visiting every node.
+   */
+  RedBlackTreeStats stats() const {
+    RedBlackTreeStats result = RedBlackTreeStats();
+    result.size = size_;
+    result.height = height(root_);
+    result.black_height = black_height(root_);
+    result.node_bytes = size_ * sizeof(NodeType);
+    result.pool_bytes = pool_->capacity() * sizeof(NodeType);
+#ifdef RED_BLACK_TREE_COUNTERS
+    result.counters = counters_.snapshot();
+#endif
+    return result;
+  }
+
+  /**
+   * @return the node holding the least value of this tree, null if it is
+   *         empty. Runs in constant time, as the tree keeps track of it.
+   */
+  NodeType* first_node() {
+    return head_;
+  }
+
+  const NodeType* first_node() const {
+    return head_;
+  }
+
+  /**
+   * @return the node holding the greatest value of this tree, null if it is
+   *         empty. Runs in constant time.
+   */
+  NodeType* last_node() {
+    return tail_;
+  }
+
+  const NodeType* last_node() const {
+    return tail_;
+  }
+
+  /**
+   * Remove the least value of this tree and hand its node over to the caller,
+   * as by {@link #extract}, without a search. Runs in amortized constant time
+   * with {@link LinkedNode}, as removal rebalances in amortized constant time,
+   * and otherwise in time O(log n).
+   *
+   * @return the handle owning the node, empty if this tree is empty.
+   */
+  NodeHandle pop_min() {
+    return head_ == nullptr ? NodeHandle() : extract(head_);
+  }
+
+  /**
+   * Remove the greatest value of this tree and hand its node over to the
+   * caller. See {@link #pop_min}.
+   *
+   * @return the handle owning the node, empty if this tree is empty.
+   */
+  NodeHandle pop_max() {
+    return tail_ == nullptr ? NodeHandle() : extract(tail_);
+  }
+
+  /**
+   * Replace the value of the specified node with the specified value, moving
+   * the node to the position of the new value, as the decrease-key operation
+   * of a priority queue and its converse. If the new value still falls between
+   * the values of the neighbors of the node, it is assigned in place without
+   * restructuring the tree, in constant time with {@link LinkedNode};
+   * otherwise the node is unlinked and linked in again at its new position,
+   * without allocation, in time O(log n). The node is left unchanged if
+   * another node holds a value equivalent to the new value.
+   *
+   * @param node
+   *            a node of this tree.
+   * @param value
+   *            the new value.
+   * @return true if the value of the node was replaced, false otherwise.
+   */
+  bool update_key(const NodeType* node, T value) {
+    NodeType* target = const_cast<NodeType*>(node);
+    const NodeType* previous = predecessor(node);
+    const NodeType* next = successor(node);
+    if ((previous == nullptr || compare(previous->value(), value) < 0)
+        && (next == nullptr || compare(value, next->value()) < 0)) {
+      set_value(target, std::move(value));
+      update_path(target);
+      return true;
+    }
+    unlink(target);
+    bool moved = insert_from(root_, value, [this, target, &value](NodeType*&) {
+      set_value(target, std::move(value));
+      return target;
+    }).second;
+    if (!moved) {
+      insert_from(root_, target->value(), [target](NodeType*&) { return target; });
+    }
+    return moved;
+  }
+
+  /**
+   * Get the node that stores the specified value.
+   *
+   * @param value
+   *            the query value.
+   * @return the node that stores the specified value, null if none.
+   */
+  NodeType* node(const T& value) {
+    return get_node_impl(value);
+  }
+
+  /**
+   * Get the node that stores a value equivalent to the specified key. Available
+   * when the comparator is transparent.
+   *
+   * @param key
+   *            the query key.
+   * @return the node that stores a value equivalent to key, null if none.
+   */
+  template<class K, class C = Compare, class = typename C::is_transparent>
+  NodeType* node(const K& key) {
+    return get_node_impl(key);
+  }
+
+  /**
+   * Get the node that stores the specified value.
+   *
+   * @param value
+   *            the query value.
+   * @return the node that stores the specified value, null if none.
+   */
+  const NodeType* node(const T& value) const {
+    return get_node_impl(value);
+  }
+
+  /**
+   * Get the node that stores a value equivalent to the specified key. Available
+   * when the comparator is transparent.
+   *
+   * @param key
+   *            the query key.
+   * @return the node that stores a value equivalent to key, null if none.
+   */
+  template<class K, class C = Compare, class = typename C::is_transparent>
+  const NodeType* node(const K& key) const {
+    return get_node_impl(key);
+  }
+
+  NodeType* root() {
+    return root_;
+  }
+
+  const NodeType* root() const {
+    return root_;
+  }
+
+  /**
+   * Get the predecessor of the specified node. The predecessor of a node n is
+   * the node with the largest value in the tree smaller than the value stored
+   * at n.
+   *
+   * @see CLRS
+   */
+  NodeType* predecessor(NodeType* node) {
+    return predecessor_impl(node);
+  }
+
+  /**
+   * Get the predecessor of the specified node. The predecessor of a node n is
+   * the node with the largest value in the tree smaller than the value stored
+   * at n.
+   *
+   * @see CLRS
+   */
+  const NodeType* predecessor(const NodeType* node) const {
+    return predecessor_impl(node);
+  }
+
+  /**
+   * Get the successor of the specified node. The successor of a node n is the
+   * node with the smallest value in the tree larger than the value stored at n.
+   *
+   * @see CLRS
+   */
+  NodeType* successor(NodeType* node) {
+    return successor_impl(node);
+  }
+
+  /**
+   * Get the successor of the specified node. The successor of a node n is the
+   * node with the smallest value in the tree larger than the value stored at n.
+   *
+   * @see CLRS
+   */
+  const NodeType* successor(const NodeType* node) const {
+    return successor_impl(node);
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  bool contains(const T& value) const {
+    return node(value) != nullptr;
+  }
+
+  /**
+   * Test whether or not a value equivalent to the specified key is an element
+   * of this tree. Available when the comparator is transparent.
+   *
+   * @param key
+   *            the query key.
+   * @return true if a value equivalent to key is an element of this tree,
+   *         false otherwise.
+   */
+  template<class K, class C = Compare, class = typename C::is_transparent>
+  bool contains(const K& key) const {
+    return get_node_impl(key) != nullptr;
+  }
+
+  /**
+   * Look up each of the specified keys, writing to out, in order, the node
+   * that stores each key or null if none. The searches for up to
+   * BATCH_WIDTH keys proceed in lockstep, one level at a time, and the next
+   * node of each search is prefetched, so that the cache misses of the
+   * searches overlap rather than follow one another.
+   *
+   * @param begin
+   *            the beginning of the keys, a forward iterator.
+   * @param end
+   *            the end of the keys.
+   * @param out
+   *            an output iterator accepting a (const) NodeType* per key.
+   */
+  template<class Iterator, class OutputIterator>
+  void find_batch(Iterator begin, Iterator end, OutputIterator out) const {
+    find_batch_impl(begin, end, [&out](NodeType* node) { *out++ = node; });
+  }
+
+  /**
+   * Test each of the specified keys for membership, writing to out, in order,
+   * a bool per key. See {@link #find_batch}.
+   */
+  template<class Iterator, class OutputIterator>
+  void contains_batch(Iterator begin, Iterator end, OutputIterator out) const {
+    find_batch_impl(begin, end, [&out](NodeType* node) { *out++ = node != nullptr; });
+  }
+
+  /**
+   * Get the node that stores the k'th smallest value in this tree. Requires
+   * OrderStatisticNode; runs in time O(log n).
+   *
+   * @param k
+   *            the zero-based rank of the requested value.
+   * @return the node that stores the k'th smallest value, null if k is not less
+   *         than the size of this tree.
+   */
+  NodeType* select(uint32_t k) {
+    return select_impl(k);
+  }
+
+  /**
+   * Get the node that stores the k'th smallest value in this tree. Requires
+   * OrderStatisticNode; runs in time O(log n).
+   *
+   * @param k
+   *            the zero-based rank of the requested value.
+   * @return the node that stores the k'th smallest value, null if k is not less
+   *         than the size of this tree.
+   */
+  const NodeType* select(uint32_t k) const {
+    return select_impl(k);
+  }
+
+  /**
+   * Get the number of values in this tree that are smaller than the specified
+   * value, which is the zero-based rank of value if it is an element of this
+   * tree. Requires OrderStatisticNode; runs in time O(log n).
+   *
+   * @param value
+   *            the query value.
+   * @return the number of values smaller than the specified value.
+   */
+  template<class K>
+  uint32_t rank(const K& value) const {
+    return count_below(value, false);
+  }
+
+  /**
+   * Get the number of values in this tree that lie in the closed range [lo,
+   * hi]. Requires OrderStatisticNode; runs in time O(log n).
+   *
+   * @param lo
+   *            the lower bound of the range, inclusive.
+   * @param hi
+   *            the upper bound of the range, inclusive.
+   * @return the number of values v with lo <= v <= hi.
+   */
+  template<class K>
+  uint32_t count_range(const K& lo, const K& hi) const {
+    if (compare(lo, hi) > 0) {
+      return 0;
+    }
+    return count_below(hi, true) - count_below(lo, false);
+  }
+
+  /**
+   * Combine the values v of this tree with lo <= v <= hi, in order, under the
+   * operation of the policy of AugmentedNode. Requires AugmentedNode; runs in
+   * time O(log n).
+   *
+   * @param lo
+   *            the lower bound of the range, inclusive.
+   * @param hi
+   *            the upper bound of the range, inclusive.
+   * @return the aggregate of the values in the range, the identity if none.
+   */
+  template<class K, class N = NodeType>
+  typename N::aggregate_type aggregate(const K& lo, const K& hi) const {
+    typedef typename N::policy_type P;
+    if (compare(lo, hi) > 0) {
+      return P::identity();
+    }
+    // Find the topmost node in the range, below which the paths to the two
+    // bounds diverge.
+    NodeType* split = root_;
+    while (split != nullptr) {
+      if (compare(split->value(), lo) < 0) {
+        split = split->right();
+      } else if (compare(split->value(), hi) > 0) {
+        split = split->left();
+      } else {
+        break;
+      }
+    }
+    if (split == nullptr) {
+      return P::identity();
+    }
+    // Each node in range on the path to lo contributes itself and its right
+    // subtree, ahead of what has been gathered; symmetrically toward hi.
+    typename P::value_type left = P::identity();
+    for (NodeType* node = split->left(); node != nullptr;) {
+      if (compare(node->value(), lo) < 0) {
+        node = node->right();
+      } else {
+        left = P::combine(P::combine(P::lift(node->value()), aggregate_of(node->right())), left);
+        node = node->left();
+      }
+    }
+    typename P::value_type right = P::identity();
+    for (NodeType* node = split->right(); node != nullptr;) {
+      if (compare(node->value(), hi) > 0) {
+        node = node->left();
+      } else {
+        right = P::combine(right, P::combine(aggregate_of(node->left()), P::lift(node->value())));
+        node = node->right();
+      }
+    }
+    return P::combine(P::combine(left, P::lift(split->value())), right);
+  }
+
+  const_iterator begin() const {
+    return const_iterator(this, first_node());
+  }
+
+  const_iterator end() const {
+    return const_iterator(this, nullptr);
+  }
+
+  /**
+   * @return an iterator to the specified node of this tree, or end() if node
+   *         is null.
+   */
+  const_iterator iterator_to(const NodeType* node) const {
+    return const_iterator(this, node);
+  }
+
+  const_reverse_iterator rbegin() const {
+    return const_reverse_iterator(end());
+  }
+
+  const_reverse_iterator rend() const {
+    return const_reverse_iterator(begin());
+  }
+
+  /**
+   * Get an iterator to the smallest value of this tree that is not less than
+   * the specified key.
+   *
+   * @param key
+   *            the query key.
+   * @return an iterator to the first value v with v >= key, end() if none.
+   */
+  template<class K>
+  const_iterator lower_bound(const K& key) const {
+    return const_iterator(this, bound(key, 0));
+  }
+
+  /**
+   * Get an iterator to the smallest value of this tree that is greater than
+   * the specified key.
+   *
+   * @param key
+   *            the query key.
+   * @return an iterator to the first value v with v > key, end() if none.
+   */
+  template<class K>
+  const_iterator upper_bound(const K& key) const {
+    return const_iterator(this, bound(key, 1));
+  }
+
+  /**
+   * Get the range of values of this tree equivalent to the specified key,
+   * which holds at most one value.
+   *
+   * @param key
+   *            the query key.
+   * @return the pair (lower_bound(key), upper_bound(key)).
+   */
+  template<class K>
+  std::pair<const_iterator, const_iterator> equal_range(const K& key) const {
+    const_iterator lower = lower_bound(key);
+    const_iterator upper = lower;
+    if (upper != end() && compare(*upper, key) == 0) {
+      ++upper;
+    }
+    return std::make_pair(lower, upper);
+  }
+
+  /**
+   * Apply the specified function to each value v of this tree with lo <= v <=
+   * hi, in order. Runs in time O(log n + k), where k is the number of such
+   * values; with {@link LinkedNode} the scan follows the successor threads and
+   * never climbs the tree.
+   *
+   * @param lo
+   *            the lower bound of the range, inclusive.
+   * @param hi
+   *            the upper bound of the range, inclusive.
+   * @param function
+   *            the function to apply to each value, as function(value).
+   */
+  template<class K, class Function>
+  void for_each_in_range(const K& lo, const K& hi, Function function) const {
+    for (const NodeType* node = bound(lo, 0); node != nullptr && compare(node->value(), hi) <= 0;
+        node = successor(node)) {
+      function(node->value());
+    }
+  }
+
+protected:
+  /**
+   * Perform a right rotate operation on the specified node.
+   *
+   * @param node
+   *            the node on which a right rotate operation is to be performed.
+   *
+   * @see CLRS Introduction to Algorithms
+   */
+  void right_rotate(NodeType* node) {
+    right_rotate(node, root_);
+  }
+
+  /**
+   * Perform a right rotate operation on the specified node.
+   *
+   * @param node
+   *            the node on which a right rotate operation is to be performed.
+   * @param root
+   *            the root of the (sub)tree containing node, updated if node is
+   *            the root.
+   */
+  void right_rotate(NodeType* node, NodeType*& root) {
+    RED_BLACK_TREE_COUNT(ROTATIONS);
+    NodeType* temp = node->left();
+    node->set_left(temp->right());
+    if (temp->right() != nullptr)
+      temp->right()->set_parent(node);
+    temp->set_parent(node->parent());
+    if (node->parent() == nullptr)
+      root = temp;
+    else if (node == node->parent()->right())
+      node->parent()->set_right(temp);
+    else
+      node->parent()->set_left(temp);
+    temp->set_right(node);
+    node->set_parent(temp);
+    update(node);
+    update(temp);
+  }
+
+  /**
+   * Perform a left rotate operation on the specified node.
+   *
+   * @param node
+   *            the node on which the left rotate operation will be performed.
+   *
+   * @see CLRS Introduction to Algorithms
+   */
+  void left_rotate(NodeType* node) {
+    left_rotate(node, root_);
+  }
+
+  /**
+   * Perform a left rotate operation on the specified node.
+   *
+   * @param node
+   *            the node on which the left rotate operation will be performed.
+   * @param root
+   *            the root of the (sub)tree containing node, updated if node is
+   *            the root.
+   */
+  void left_rotate(NodeType* node, NodeType*& root) {
+    RED_BLACK_TREE_COUNT(ROTATIONS);
+    NodeType* temp = node->right();
+    node->set_right(temp->left());
+    if (temp->left() != nullptr)
+      temp->left()->set_parent(node);
+
+    temp->set_parent(node->parent());
+    if (node->parent() == nullptr)
+      root = temp;
+    else if (node == node->parent()->left())
+      node->parent()->set_left(temp);
+    else
+      node->parent()->set_right(temp);
+
+    temp->set_left(node);
+    node->set_parent(temp);
+    update(node);
+    update(temp);
   }
 
   /**
@@ -328,7 +1434,22 @@ protected:
    * @see CLRS Introduction to Algorithms
    */
   void fix_after_insertion(NodeType* node) {
+    fix_after_insertion(node, root_);
+  }
+
+  /**
+   * Re-balance a (sub)tree after a red node has been linked into it.
+   *
+   * @param node
+   *            the linked node.
+   * @param root
+   *            the root of the (sub)tree, updated by rotations at the root.
+   * @return true if the root had to be recolored black, which increases the
+   *         black height of the (sub)tree by one.
+   */
+  bool fix_after_insertion(NodeType* node, NodeType*& root) {
     while (color(node->parent()) == RED) {
+      RED_BLACK_TREE_COUNT(FIXUP_ITERATIONS);
       if (node->parent() == node->parent()->parent()->left()) {
         NodeType* temp = node->parent()->parent()->right();
         if (color(temp) == RED) {
@@ -339,11 +1460,11 @@ protected:
         } else {
           if (node == node->parent()->right()) {
             node = node->parent();
-            left_rotate(node);
+            left_rotate(node, root);
           }
           set_color(node->parent(), BLACK);
           set_color(node->parent()->parent(), RED);
-          right_rotate(node->parent()->parent());
+          right_rotate(node->parent()->parent(), root);
         }
       } else {
         NodeType* temp = node->parent()->parent()->left();
@@ -355,107 +1476,796 @@ protected:
         } else {
           if (node == node->parent()->left()) {
             node = node->parent();
-            right_rotate(node);
+            right_rotate(node, root);
           }
           set_color(node->parent(), BLACK);
           set_color(node->parent()->parent(), RED);
-          left_rotate(node->parent()->parent());
+          left_rotate(node->parent()->parent(), root);
+        }
+      }
+    }
+    if (root->color() == RED) {
+      root->set_color(BLACK);
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * Re-balance the tree after a remove operation.
+   *
+   * @param node
+   *            the removed node or the swap node.
+   *
+   * @see CLRS Introduction to Algorithms
+   */
+  void fix_after_removal(NodeType* node) {
+    while (node != root_ && color(node) == BLACK) {
+      RED_BLACK_TREE_COUNT(FIXUP_ITERATIONS);
+      if (node == node->parent()->left()
+          || (node->parent()->right() != nullptr && node != node->parent()->right())) {
+        NodeType* temp = node->parent()->right();
+        if (color(temp) == RED) {
+          set_color(temp, BLACK);
+          set_color(node->parent(), RED);
+          left_rotate(node->parent());
+          temp = node->parent()->right();
+        }
+        if (color(temp->left()) == BLACK && color(temp->right()) == BLACK) {
+          set_color(temp, RED);
+          node = node->parent();
+        } else {
+          if (color(temp->right()) == BLACK) {
+            set_color(temp->left(), BLACK);
+            set_color(temp, RED);
+            right_rotate(temp);
+            temp = node->parent()->right();
+          }
+          set_color(temp, color(node->parent()));
+          set_color(node->parent(), BLACK);
+          set_color(temp->right(), BLACK);
+          left_rotate(node->parent());
+          node = root_;
+        }
+      } else {
+        NodeType* temp = node->parent()->left();
+        if (color(temp) == RED) {
+          set_color(temp, BLACK);
+          set_color(node->parent(), RED);
+          right_rotate(node->parent());
+          temp = node->parent()->left();
+        }
+        if (color(temp->right()) == BLACK && color(temp->left()) == BLACK) {
+          set_color(temp, RED);
+          node = node->parent();
+        } else {
+          if (color(temp->left()) == BLACK) {
+            set_color(temp->right(), BLACK);
+            set_color(temp, RED);
+            left_rotate(temp);
+            temp = node->parent()->left();
+          }
+          set_color(temp, color(node->parent()));
+          set_color(node->parent(), BLACK);
+          set_color(temp->left(), BLACK);
+          right_rotate(node->parent());
+          node = root_;
+        }
+      }
+    }
+    set_color(node, BLACK);
+  }
+
+  /**
+   * Unlink the specified node from this tree and re-balance. A node with two
+   * children is replaced by its successor node, which is relinked into its
+   * place, rather than by its successor's value, so that values are never
+   * copied and every other node keeps its value.
+   *
+   * @param node
+   *            the node to unlink.
+   *
+   * @see CLRS Introduction to Algorithms, 3rd ed., RB-DELETE
+   */
+  void unlink(NodeType* node) {
+    if (node == head_) {
+      head_ = successor_internal(node);
+    }
+    if (node == tail_) {
+      tail_ = predecessor_internal(node);
+    }
+    NodeColor removed_color = node->color();
+    NodeType* child;
+    NodeType* child_parent;
+    if (node->left() == nullptr || node->right() == nullptr) {
+      child = node->left() != nullptr ? node->left() : node->right();
+      child_parent = node->parent();
+      transplant(node, child);
+    } else {
+      NodeType* successor = leftmost(node->right());
+      removed_color = successor->color();
+      child = successor->right();
+      if (successor->parent() == node) {
+        child_parent = successor;
+      } else {
+        child_parent = successor->parent();
+        transplant(successor, child);
+        successor->set_right(node->right());
+        successor->right()->set_parent(successor);
+      }
+      transplant(node, successor);
+      successor->set_left(node->left());
+      successor->left()->set_parent(successor);
+      successor->set_color(node->color());
+    }
+    update_path(child_parent);
+    if (removed_color == BLACK && root_ != nullptr) {
+      if (child == nullptr) {
+        // Stand the unlinked node in for the missing child, whose parent
+        // fix_after_removal must know; its side is inferred from the sibling.
+        node->set_left(nullptr);
+        node->set_right(nullptr);
+        node->set_parent(child_parent);
+        node->set_color(BLACK);
+        child = node;
+      }
+      fix_after_removal(child);
+    }
+    --size_;
+    post_delete(node);
+    node->set_parent(nullptr);
+    node->set_left(nullptr);
+    node->set_right(nullptr);
+  }
+
+  /**
+   * Put the specified replacement, which may be null, in the place of the
+   * specified node as the child of its parent.
+   */
+  void transplant(NodeType* node, NodeType* replacement) {
+    NodeType* parent = node->parent();
+    if (parent == nullptr) {
+      root_ = replacement;
+    } else if (node == parent->left()) {
+      parent->set_left(replacement);
+    } else {
+      parent->set_right(replacement);
+    }
+    if (replacement != nullptr) {
+      replacement->set_parent(parent);
+    }
+  }
+
+private:
+  /**
+   * A subtree detached from any tree, together with its black height: the
+   * number of black nodes on every path from its root to a leaf. Detached
+   * subtrees always have a black root. For node types that thread their nodes
+   * in order, the first and last nodes of the subtree are tracked as well.
+   */
+  struct Subtree {
+    NodeType* root;
+    uint32_t black_height;
+    NodeType* first;
+    NodeType* last;
+
+    Subtree() : root(nullptr), black_height(0), first(nullptr), last(nullptr) {}
+  };
+
+  /**
+   * State shared by the recursive steps of a set operation: nodes to be
+   * released once the operation completes, chained through their parent links,
+   * the number of values found in both operands and the remaining depth of
+   * recursion at which work may be forked onto another thread.
+   */
+  struct SetOperation {
+    NodeType* garbage;
+    uint32_t matches;
+    uint32_t forks;
+
+    explicit SetOperation(uint32_t forks) : garbage(nullptr), matches(0), forks(forks) {}
+  };
+
+  // Subtrees of black height below this are too small to be worth a thread.
+  static const uint32_t MIN_PARALLEL_BLACK_HEIGHT = 8;
+
+  // The number of searches interleaved by find_batch.
+  static const uint32_t BATCH_WIDTH = 16;
+
+  Compare compare_;
+  std::shared_ptr<Pool> pool_;
+  NodeType* root_;
+  // The nodes holding the least and greatest values, kept up to date by every
+  // operation that links or unlinks nodes.
+  NodeType* head_;
+  NodeType* tail_;
+  uint32_t size_;
+
+#ifdef RED_BLACK_TREE_COUNTERS
+  /**
+   * Operation counts, which are bumped with relaxed loads and stores rather
+   * than read-modify-write operations so as to stay cheap: they are exact when
+   * a tree is used by one thread at a time, and may miss increments made by
+   * concurrent readers or by the threads of a parallel set operation.
+   */
+  class OperationCounters {
+  public:
+    enum Counter {
+      COMPARISONS, ROTATIONS, RECOLORINGS, FIXUP_ITERATIONS, ALLOCATIONS, COUNTER_COUNT
+    };
+
+    OperationCounters() {
+      for (std::atomic<uint64_t>& count : counts_) {
+        count.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void tally(Counter counter) const {
+      std::atomic<uint64_t>& count = counts_[counter];
+      count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    RedBlackTreeCounters snapshot() const {
+      RedBlackTreeCounters result;
+      result.comparisons = counts_[COMPARISONS].load(std::memory_order_relaxed);
+      result.rotations = counts_[ROTATIONS].load(std::memory_order_relaxed);
+      result.recolorings = counts_[RECOLORINGS].load(std::memory_order_relaxed);
+      result.fixup_iterations = counts_[FIXUP_ITERATIONS].load(std::memory_order_relaxed);
+      result.allocations = counts_[ALLOCATIONS].load(std::memory_order_relaxed);
+      return result;
+    }
+
+  private:
+    mutable std::atomic<uint64_t> counts_[COUNTER_COUNT];
+  };
+
+  OperationCounters counters_;
+#endif
+
+  /**
+   * Register the pointers into the tree that the pool must rebase should it
+   * move its nodes.
+   */
+  void track_anchors() {
+    pool_->track(&root_);
+    pool_->track(&head_);
+    pool_->track(&tail_);
+  }
+
+  void untrack_anchors() {
+    pool_->untrack(&root_);
+    pool_->untrack(&head_);
+    pool_->untrack(&tail_);
+  }
+
+  /**
+   * Assign the specified value to the specified node, which must be unlinked
+   * or keep its position in the order.
+   */
+  static void set_value(NodeType* node, T&& value) {
+    const_cast<T&>(node->value()) = std::move(value);
+  }
+
+  /**
+   * Detach every node of the specified subtree and pass it to the specified
+   * disposer. The walk descends to a leaf, detaches it from its parent and
+   * disposes of it, so that it needs no auxiliary storage.
+   */
+  template<class Disposer>
+  void dispose_subtree(NodeType* root, Disposer dispose) {
+    if (root == nullptr) {
+      return;
+    }
+    NodeType* top = root->parent();
+    if (top != nullptr) {
+      if (top->left() == root) {
+        top->set_left(nullptr);
+      } else {
+        top->set_right(nullptr);
+      }
+      root->set_parent(nullptr);
+    }
+    NodeType* node = root;
+    while (node != nullptr) {
+      if (node->left() != nullptr) {
+        node = node->left();
+      } else if (node->right() != nullptr) {
+        node = node->right();
+      } else {
+        NodeType* parent = node->parent();
+        if (parent != nullptr) {
+          if (parent->left() == node) {
+            parent->set_left(nullptr);
+          } else {
+            parent->set_right(nullptr);
+          }
+        }
+        dispose(node);
+        node = parent;
+      }
+    }
+  }
+
+  /**
+   * Make this tree's pool responsible for the nodes of the specified tree: its
+   * pool is absorbed if this tree is its only user and the pools can exchange
+   * storage, and otherwise its values are moved, in order, into nodes
+   * allocated from this tree's pool, which are linked in balanced form in time
+   * O(n) without comparisons or auxiliary storage.
+   */
+  void adopt(RedBlackTree& other) {
+    if (other.pool_ == pool_) {
+      return;
+    }
+    if (other.pool_.use_count() == 1 && pool_->absorb(*other.pool_)) {
+      // Absorbing carries the other tree's root over to this tree's pool.
+      other.pool_ = pool_;
+      return;
+    }
+    std::shared_ptr<Pool> old_pool = other.pool_;
+    NodeType* old_root = other.root_;
+    NodeType* old_node = leftmost(old_root);
+    uint32_t count = other.size_;
+    other.root_ = nullptr;
+    other.head_ = nullptr;
+    other.tail_ = nullptr;
+    other.size_ = 0;
+    other.use_pool(pool_);
+    pool_->reserve(count);
+    auto next_node = [this, &old_node]() {
+      NodeType* node = pool_->allocate(std::move(const_cast<T&>(old_node->value())));
+      RED_BLACK_TREE_COUNT(ALLOCATIONS);
+      transfer_occurrences(node, old_node);
+      old_node = successor_internal(old_node);
+      return node;
+    };
+    other.build_tree(next_node, count);
+    dispose_subtree(old_root, [&old_pool](NodeType* node) { old_pool->release(node); });
+  }
+
+  /**
+   * Allocate nodes from the specified pool from now on.
+   */
+  void use_pool(const std::shared_ptr<Pool>& pool) {
+    if (pool != pool_) {
+      untrack_anchors();
+      pool_ = pool;
+      track_anchors();
+    }
+  }
+
+  /**
+   * Allocate a node constructed from the specified arguments, keeping the
+   * specified pointer into the tree valid should the pool move its nodes.
+   */
+  template<class... Args>
+  NodeType* allocate(NodeType*& anchor, Args&&... args) {
+    pool_->track(&anchor);
+    NodeType* node;
+    try {
+      node = pool_->allocate(std::forward<Args>(args)...);
+    } catch (...) {
+      pool_->untrack(&anchor);
+      throw;
+    }
+    pool_->untrack(&anchor);
+    RED_BLACK_TREE_COUNT(ALLOCATIONS);
+    return node;
+  }
+
+  /**
+   * Detach the nodes of this tree as a subtree, leaving this tree empty.
+   */
+  Subtree detach() {
+    Subtree result;
+    result.root = root_;
+    result.black_height = black_height(root_);
+    result.first = leftmost(root_);
+    result.last = rightmost(root_);
+    root_ = nullptr;
+    head_ = nullptr;
+    tail_ = nullptr;
+    size_ = 0;
+    return result;
+  }
+
+  /**
+   * Make the specified subtree the contents of this tree, which must be empty.
+   */
+  void attach(const Subtree& tree, uint32_t size) {
+    root_ = tree.root;
+    // Subtrees track their first and last nodes only for threaded node types,
+    // so the extremes are found by descent; attaching costs O(log n) anyway.
+    head_ = leftmost(root_);
+    tail_ = rightmost(root_);
+    size_ = size;
+    if (root_ != nullptr) {
+      link_in_order(static_cast<NodeType*>(nullptr), tree.first);
+      link_in_order(tree.last, static_cast<NodeType*>(nullptr));
+    }
+  }
+
+  static uint32_t height(const NodeType* node) {
+    return node == nullptr ? 0 : 1 + std::max(height(node->left()), height(node->right()));
+  }
+
+  static uint32_t black_height(const NodeType* node) {
+    uint32_t result = 0;
+    for (; node != nullptr; node = node->left()) {
+      if (node->color() == BLACK) {
+        ++result;
+      }
+    }
+    return result;
+  }
+
+  static NodeType* leftmost(NodeType* node) {
+    if (node != nullptr) {
+      while (node->left() != nullptr) {
+        node = node->left();
+      }
+    }
+    return node;
+  }
+
+  static NodeType* rightmost(NodeType* node) {
+    if (node != nullptr) {
+      while (node->right() != nullptr) {
+        node = node->right();
+      }
+    }
+    return node;
+  }
+
+  /**
+   * Detach the root of the specified subtree from its children, which become
+   * subtrees in their own right.
+   */
+  inline void expose(const Subtree& tree, Subtree& left, Subtree& right) {
+    NodeType* node = tree.root;
+    uint32_t height = tree.black_height - (node->color() == BLACK ? 1 : 0);
+    left = Subtree();
+    right = Subtree();
+    if (node->left() != nullptr) {
+      left.root = node->left();
+      left.black_height = height;
+      left.first = tree.first;
+      left.last = threaded_predecessor(node);
+      make_subtree(left);
+    }
+    if (node->right() != nullptr) {
+      right.root = node->right();
+      right.black_height = height;
+      right.first = threaded_successor(node);
+      right.last = tree.last;
+      make_subtree(right);
+    }
+    node->set_left(nullptr);
+    node->set_right(nullptr);
+  }
+
+  inline void make_subtree(Subtree& tree) {
+    tree.root->set_parent(nullptr);
+    if (tree.root->color() == RED) {
+      tree.root->set_color(BLACK);
+      ++tree.black_height;
+    }
+  }
+
+  /**
+   * Join the specified subtrees about the specified node, all values of left
+   * being smaller than that of node and all values of right being larger. Runs
+   * in time proportional to the difference in black heights of the subtrees.
+   *
+   * @see Blelloch, Ferizovic and Sun. Just Join for Parallel Ordered Sets.
+   *      SPAA 2016.
+   */
+  Subtree join_subtrees(const Subtree& left, NodeType* node, const Subtree& right) {
+    link_in_order(left.last, node);
+    link_in_order(node, right.first);
+    Subtree result;
+    result.first = left.root != nullptr ? left.first : node;
+    result.last = right.root != nullptr ? right.last : node;
+    node->set_parent(nullptr);
+    if (left.black_height == right.black_height) {
+      link_children(node, left.root, right.root);
+      node->set_color(BLACK);
+      update(node);
+      result.root = node;
+      result.black_height = left.black_height + 1;
+      return result;
+    }
+    if (left.black_height > right.black_height) {
+      // Find the black node on the right spine of left having the black height
+      // of right and put node in its place.
+      uint32_t height = left.black_height;
+      NodeType* parent = nullptr;
+      NodeType* child = left.root;
+      while (height != right.black_height || color(child) == RED) {
+        if (color(child) == BLACK) {
+          --height;
+        }
+        parent = child;
+        child = child->right();
+      }
+      link_children(node, child, right.root);
+      node->set_parent(parent);
+      parent->set_right(node);
+      result.root = left.root;
+      result.black_height = left.black_height;
+    } else {
+      uint32_t height = right.black_height;
+      NodeType* parent = nullptr;
+      NodeType* child = right.root;
+      while (height != left.black_height || color(child) == RED) {
+        if (color(child) == BLACK) {
+          --height;
         }
+        parent = child;
+        child = child->left();
       }
+      link_children(node, left.root, child);
+      node->set_parent(parent);
+      parent->set_left(node);
+      result.root = right.root;
+      result.black_height = right.black_height;
+    }
+    node->set_color(RED);
+    update_path(node);
+    if (fix_after_insertion(node, result.root)) {
+      ++result.black_height;
+    }
+    return result;
+  }
+
+  /**
+   * Join the specified subtrees, all values of left being smaller than all
+   * values of right.
+   */
+  Subtree join_subtrees(const Subtree& left, const Subtree& right) {
+    if (left.root == nullptr) {
+      return right;
+    }
+    if (right.root == nullptr) {
+      return left;
+    }
+    Subtree rest;
+    NodeType* last = split_last(left, rest);
+    return join_subtrees(rest, last, right);
+  }
+
+  /**
+   * Detach the node holding the largest value of the specified non-empty
+   * subtree, leaving the remaining nodes in rest.
+   */
+  NodeType* split_last(const Subtree& tree, Subtree& rest) {
+    NodeType* node = tree.root;
+    Subtree left;
+    Subtree right;
+    expose(tree, left, right);
+    if (right.root == nullptr) {
+      rest = left;
+      return node;
+    }
+    Subtree right_rest;
+    NodeType* last = split_last(right, right_rest);
+    rest = join_subtrees(left, node, right_rest);
+    return last;
+  }
+
+  /**
+   * Split the specified subtree into the values smaller than key and those
+   * larger than key.
+   *
+   * @return the detached node holding a value equivalent to key, null if none.
+   */
+  template<class K>
+  NodeType* split_subtree(const Subtree& tree, const K& key, Subtree& less, Subtree& greater) {
+    if (tree.root == nullptr) {
+      less = Subtree();
+      greater = Subtree();
+      return nullptr;
+    }
+    NodeType* node = tree.root;
+    Subtree left;
+    Subtree right;
+    expose(tree, left, right);
+    int delta = compare(node->value(), key);
+    if (delta == 0) {
+      less = left;
+      greater = right;
+      return node;
+    }
+    NodeType* found;
+    if (delta > 0) {
+      Subtree middle;
+      found = split_subtree(left, key, less, middle);
+      greater = join_subtrees(middle, node, right);
+    } else {
+      Subtree middle;
+      found = split_subtree(right, key, middle, greater);
+      less = join_subtrees(left, node, middle);
+    }
+    return found;
+  }
+
+  Subtree union_subtrees(const Subtree& a, const Subtree& b, SetOperation& operation) {
+    if (a.root == nullptr) {
+      return b;
+    }
+    if (b.root == nullptr) {
+      return a;
+    }
+    NodeType* node = b.root;
+    Subtree b_less;
+    Subtree b_greater;
+    expose(b, b_less, b_greater);
+    Subtree a_less;
+    Subtree a_greater;
+    NodeType* found = split_subtree(a, node->value(), a_less, a_greater);
+    if (found != nullptr) {
+      merge_occurrences(node, found);
+      discard(found, operation);
+    }
+    Subtree less;
+    Subtree greater;
+    bool parallel = std::min(a.black_height, b.black_height) >= MIN_PARALLEL_BLACK_HEIGHT;
+    fork_join(parallel, operation,
+        [&](SetOperation& op) { less = union_subtrees(a_less, b_less, op); },
+        [&](SetOperation& op) { greater = union_subtrees(a_greater, b_greater, op); });
+    return join_subtrees(less, node, greater);
+  }
+
+  Subtree intersect_subtrees(const Subtree& a, const NodeType* b, SetOperation& operation) {
+    if (a.root == nullptr) {
+      return a;
+    }
+    if (b == nullptr) {
+      a.root->set_parent(operation.garbage);
+      operation.garbage = a.root;
+      return Subtree();
     }
-    set_color(root_, BLACK);
+    Subtree a_less;
+    Subtree a_greater;
+    NodeType* found = split_subtree(a, b->value(), a_less, a_greater);
+    Subtree less;
+    Subtree greater;
+    bool parallel = a.black_height >= MIN_PARALLEL_BLACK_HEIGHT;
+    fork_join(parallel, operation,
+        [&](SetOperation& op) { less = intersect_subtrees(a_less, b->left(), op); },
+        [&](SetOperation& op) { greater = intersect_subtrees(a_greater, b->right(), op); });
+    if (found == nullptr) {
+      return join_subtrees(less, greater);
+    }
+    ++operation.matches;
+    return join_subtrees(less, found, greater);
+  }
+
+  Subtree difference_subtrees(const Subtree& a, const NodeType* b, SetOperation& operation) {
+    if (a.root == nullptr || b == nullptr) {
+      return a;
+    }
+    Subtree a_less;
+    Subtree a_greater;
+    NodeType* found = split_subtree(a, b->value(), a_less, a_greater);
+    if (found != nullptr) {
+      discard(found, operation);
+    }
+    Subtree less;
+    Subtree greater;
+    bool parallel = a.black_height >= MIN_PARALLEL_BLACK_HEIGHT;
+    fork_join(parallel, operation,
+        [&](SetOperation& op) { less = difference_subtrees(a_less, b->left(), op); },
+        [&](SetOperation& op) { greater = difference_subtrees(a_greater, b->right(), op); });
+    return join_subtrees(less, greater);
   }
 
   /**
-   * Re-balance the tree after a remove operation.
-   *
-   * @param node
-   *            the removed node or the swap node.
-   *
-   * @see CLRS Introduction to Algorithms
+   * Run the two specified steps of a set operation, the first on another
+   * thread if parallel is set and the operation may still fork. The forked
+   * step accumulates into its own state, which is merged once both are done.
    */
-  void fix_after_removal(NodeType* node) {
-    while (node != root_ && color(node) == BLACK) {
-      if (node == node->parent()->left()
-          || (node->parent()->right() != nullptr && node != node->parent()->right())) {
-        NodeType* temp = node->parent()->right();
-        if (color(temp) == RED) {
-          set_color(temp, BLACK);
-          set_color(node->parent(), RED);
-          left_rotate(node->parent());
-          temp = node->parent()->right();
-        }
-        if (color(temp->left()) == BLACK && color(temp->right()) == BLACK) {
-          set_color(temp, RED);
-          node = node->parent();
-        } else {
-          if (color(temp->right()) == BLACK) {
-            set_color(temp->left(), BLACK);
-            set_color(temp, RED);
-            right_rotate(temp);
-            temp = node->parent()->right();
-          }
-          set_color(temp, color(node->parent()));
-          set_color(node->parent(), BLACK);
-          set_color(temp->right(), BLACK);
-          left_rotate(node->parent());
-          node = root_;
-        }
-      } else {
-        NodeType* temp = node->parent()->left();
-        if (color(temp) == RED) {
-          set_color(temp, BLACK);
-          set_color(node->parent(), RED);
-          right_rotate(node->parent());
-          temp = node->parent()->left();
-        }
-        if (color(temp->right()) == BLACK && color(temp->left()) == BLACK) {
-          set_color(temp, RED);
-          node = node->parent();
-        } else {
-          if (color(temp->left()) == BLACK) {
-            set_color(temp->right(), BLACK);
-            set_color(temp, RED);
-            left_rotate(temp);
-            temp = node->parent()->left();
-          }
-          set_color(temp, color(node->parent()));
-          set_color(node->parent(), BLACK);
-          set_color(temp->left(), BLACK);
-          right_rotate(node->parent());
-          node = root_;
-        }
+  template<class First, class Second>
+  void fork_join(bool parallel, SetOperation& operation, First first, Second second) {
+    if (!parallel || operation.forks == 0) {
+      first(operation);
+      second(operation);
+      return;
+    }
+    --operation.forks;
+    SetOperation forked(operation.forks);
+    std::future<void> future;
+    try {
+      future = std::async(std::launch::async, [&]() { first(forked); });
+    } catch (const std::system_error&) {
+      first(forked);
+    }
+    second(operation);
+    if (future.valid()) {
+      future.get();
+    }
+    ++operation.forks;
+    operation.matches += forked.matches;
+    if (forked.garbage != nullptr) {
+      NodeType* last = forked.garbage;
+      while (last->parent() != nullptr) {
+        last = last->parent();
       }
+      last->set_parent(operation.garbage);
+      operation.garbage = forked.garbage;
     }
-    set_color(node, BLACK);
+  }
+
+  static uint32_t fork_depth(unsigned parallelism) {
+    uint32_t result = 0;
+    while ((1u << result) < parallelism) {
+      ++result;
+    }
+    return result;
+  }
+
+  inline void discard(NodeType* node, SetOperation& operation) {
+    ++operation.matches;
+    node->set_parent(operation.garbage);
+    operation.garbage = node;
   }
 
   /**
-   * Called by {@link #remove(Node)} when the node to be removed is a leaf. In
-   * this case, the node's value is exchanged with its successor as per the
-   * typical binary tree node removal operation. This method allows a subclass
-   * to influence value exchange behavior (e.g. if additional node information
-   * needs to be exchanged).
-   *
-   * @param node
-   *            the node whose value is to be removed.
-   * @param successor
-   *            the node to actually be removed.
+   * Release the subtrees chained through their parent links by a set operation.
    */
-  void exchange_values(NodeType* n, NodeType* successor) {
-    const T tempValue = successor->value();
-    successor->set_value(n->value());
-    n->set_value(tempValue);
-    post_exchange_values(n, successor);
+  void release_garbage(NodeType* garbage) {
+    while (garbage != nullptr) {
+      NodeType* next = garbage->parent();
+      garbage->set_parent(nullptr);
+      dispose_subtree(garbage, [this](NodeType* node) { pool_->release(node); });
+      garbage = next;
+    }
   }
 
-private:
-  int (*compare_)(const T&, const T&);
-  NodeType* root_;
-  uint32_t size_;
+  /**
+   * Count the nodes of the subtree rooted at first, given that together with
+   * the subtree rooted at second it holds total nodes. The subtrees are walked
+   * in lockstep, so that only the smaller is walked in full.
+   */
+  template<class N>
+  uint32_t count_nodes(N* first, N* second, uint32_t total) {
+    if (first == nullptr || second == nullptr) {
+      return first == nullptr ? 0 : total;
+    }
+    NodeType* a = leftmost(first);
+    NodeType* b = leftmost(second);
+    uint32_t count = 0;
+    while (a != nullptr && b != nullptr) {
+      ++count;
+      a = successor_internal(a);
+      b = successor_internal(b);
+    }
+    return a == nullptr ? count : total - count;
+  }
+
+  uint32_t count_nodes(OrderStatisticNode<T>* first, OrderStatisticNode<T>* second,
+      uint32_t total) {
+    return subtree_size(first);
+  }
+
+  static inline void link_children(NodeType* node, NodeType* left, NodeType* right) {
+    node->set_left(left);
+    if (left != nullptr) {
+      left->set_parent(node);
+    }
+    node->set_right(right);
+    if (right != nullptr) {
+      right->set_parent(node);
+    }
+  }
 
   inline void set_color(NodeType* node, NodeColor color) {
     if (node != nullptr) {
+#ifdef RED_BLACK_TREE_COUNTERS
+      if (node->color() != color) {
+        RED_BLACK_TREE_COUNT(RECOLORINGS);
+      }
+#endif
       node->set_color(color);
     }
   }
@@ -473,30 +2283,283 @@ private:
     return node == nullptr ? BLACK : node->color();
   }
 
-  inline NodeType* get_first_node_impl() const {
-    NodeType* result = root;
-    if (result != nullptr) {
-      while (result->left() != nullptr) {
-        result = result->left();
+  /**
+   * Three-way comparison of the specified operands in terms of the comparator,
+   * which may itself be three-way or two-way.
+   */
+  template<class A, class B>
+  inline int compare(const A& a, const B& b) const {
+    RED_BLACK_TREE_COUNT(COMPARISONS);
+    return three_way_compare(compare_, a, b);
+  }
+
+  /**
+   * Make the specified number of nodes, obtained in order from next_node, the
+   * contents of this tree, which must be empty, linked in balanced form.
+   */
+  template<class Source>
+  void build_tree(Source& next_node, uint32_t count) {
+    size_ = count;
+    if (count == 0) {
+      head_ = nullptr;
+      tail_ = nullptr;
+      return;
+    }
+    // Nodes on the deepest level of the tree, which may be incomplete, are
+    // colored red and all others black.
+    uint32_t red_depth = 0;
+    while ((count >> (red_depth + 1)) != 0) {
+      ++red_depth;
+    }
+    NodeType* previous = nullptr;
+    root_ = build(next_node, count, 0, red_depth, previous);
+    root_->set_parent(nullptr);
+    set_color(root_, BLACK);
+    link_in_order(previous, static_cast<NodeType*>(nullptr));
+    head_ = leftmost(root_);
+    tail_ = previous;
+  }
+
+  /**
+   * Build a balanced subtree from the next count nodes obtained from
+   * next_node, which yields nodes in order.
+   *
+   * @param depth
+   *            the depth of the subtree root within the tree.
+   * @param red_depth
+   *            the depth at which nodes are colored red.
+   * @param previous
+   *            the last node built so far in order, updated as nodes are
+   *            built.
+   * @return the root of the subtree, null if count is zero.
+   */
+  template<class Source>
+  NodeType* build(Source& next_node, uint32_t count, uint32_t depth, uint32_t red_depth,
+      NodeType*& previous) {
+    if (count == 0) {
+      return nullptr;
+    }
+    uint32_t left_count = (count - 1) / 2;
+    NodeType* left = build(next_node, left_count, depth + 1, red_depth, previous);
+    NodeType* node = next_node();
+    link_in_order(previous, node);
+    previous = node;
+    NodeType* right = build(next_node, count - 1 - left_count, depth + 1, red_depth, previous);
+    node->set_left(left);
+    if (left != nullptr) {
+      left->set_parent(node);
+    }
+    node->set_right(right);
+    if (right != nullptr) {
+      right->set_parent(node);
+    }
+    node->set_color(depth == red_depth ? RED : BLACK);
+    update(node);
+    return node;
+  }
+
+  inline NodeType* select_impl(uint32_t k) const {
+    NodeType* node = root_;
+    while (node != nullptr) {
+      uint32_t left_size = subtree_size(node->left());
+      if (k < left_size) {
+        node = node->left();
+      } else if (k > left_size) {
+        k -= left_size + 1;
+        node = node->right();
+      } else {
+        break;
+      }
+    }
+    return node;
+  }
+
+  /**
+   * Count the values smaller than the specified value, or not larger than it if
+   * inclusive is set.
+   */
+  template<class K>
+  inline uint32_t count_below(const K& value, bool inclusive) const {
+    uint32_t result = 0;
+    const NodeType* node = root_;
+    while (node != nullptr) {
+      int delta = compare(node->value(), value);
+      if (delta < 0 || (delta == 0 && inclusive)) {
+        result += subtree_size(node->left()) + 1;
+        node = node->right();
+      } else if (delta > 0) {
+        node = node->left();
+      } else {
+        result += subtree_size(node->left());
+        break;
       }
     }
     return result;
   }
 
-  inline NodeType* get_last_node_impl() const {
-    NodeType* result = root;
-    if (result != nullptr) {
-      while (result->right() != nullptr) {
-        result = result->right();
+  static inline void prefetch(const void* address) {
+#if defined(__GNUC__)
+    __builtin_prefetch(address);
+#endif
+  }
+
+  /**
+   * Insert a node holding the specified value below the specified node, the
+   * root of a subtree that would contain it, or at the root if node is null.
+   * The node is obtained from make_node(parent) once its place is found, and
+   * must come from this tree's pool.
+   *
+   * @return the node holding the value and whether it was inserted.
+   */
+  template<class K, class Maker>
+  std::pair<NodeType*, bool> insert_from(NodeType* start, const K& value, Maker make_node) {
+    NodeType* parent = nullptr;
+    int delta = 0;
+    for (NodeType* next = start; next != nullptr; next = delta < 0 ? next->right() : next->left()) {
+      parent = next;
+      delta = compare(parent->value(), value);
+      if (delta == 0) {
+        return std::make_pair(parent, false);
+      }
+    }
+    NodeType* node = make_node(parent);
+    if (parent == nullptr) {
+      root_ = node;
+      head_ = node;
+      tail_ = node;
+    } else if (delta < 0) {
+      parent->set_right(node);
+      if (parent == tail_) {
+        tail_ = node;
+      }
+      // The node slots in between its parent and the parent's successor.
+      link_in_order(node, threaded_successor(parent));
+      link_in_order(parent, node);
+    } else {
+      parent->set_left(node);
+      if (parent == head_) {
+        head_ = node;
+      }
+      link_in_order(threaded_predecessor(parent), node);
+      link_in_order(node, parent);
+    }
+    node->set_parent(parent);
+
+    update_path(node);
+    set_color(node, RED);
+    fix_after_insertion(node);
+    ++size_;
+
+    return std::make_pair(node, true);
+  }
+
+  /**
+   * Find the root of the smallest subtree that is bound to contain the
+   * specified key, or the node holding it, by a finger search outward from the
+   * specified node. The key belongs next to the finger when it lies between
+   * the finger and its neighbor toward the key; otherwise the search climbs
+   * from the finger until it passes an ancestor on the far side of the key.
+   */
+  template<class K>
+  NodeType* search_from(NodeType* node, const K& key) {
+    int delta = compare(node->value(), key);
+    if (delta == 0) {
+      return node;
+    }
+    bool right = delta < 0;
+    NodeType* neighbor = right ? successor(node) : predecessor(node);
+    if (neighbor == nullptr) {
+      return node;
+    }
+    int neighbor_delta = compare(neighbor->value(), key);
+    if (neighbor_delta == 0) {
+      return neighbor;
+    }
+    if ((neighbor_delta > 0) == right) {
+      // Of two adjacent nodes, one has no child on the side facing the other.
+      return (right ? node->right() : node->left()) == nullptr ? node : neighbor;
+    }
+    node = neighbor;
+    for (NodeType* parent = node->parent(); parent != nullptr;
+        node = parent, parent = parent->parent()) {
+      if ((node == parent->left()) == right) {
+        int parent_delta = compare(parent->value(), key);
+        if (parent_delta == 0) {
+          return parent;
+        }
+        if ((parent_delta > 0) == right) {
+          break;
+        }
+      }
+    }
+    return node;
+  }
+
+  /**
+   * Find the node of the smallest value greater than key, if strict is 1, or
+   * not less than key, if strict is 0.
+   *
+   * @return the node found, null if there is none.
+   */
+  template<class K>
+  inline NodeType* bound(const K& key, int strict) const {
+    NodeType* result = nullptr;
+    NodeType* node = root_;
+    while (node != nullptr) {
+      if (compare(node->value(), key) < strict) {
+        node = node->right();
+      } else {
+        result = node;
+        node = node->left();
       }
     }
     return result;
   }
 
-  inline NodeType* get_node_impl(const T& value) const {
+  template<class Iterator, class Consumer>
+  void find_batch_impl(Iterator begin, Iterator end, Consumer consume) const {
+    Iterator keys[BATCH_WIDTH];
+    NodeType* nodes[BATCH_WIDTH];
+    // The lanes still descending, compacted after every level so that a lane
+    // is no longer visited once its key is found or its search falls off.
+    uint32_t lanes[BATCH_WIDTH];
+    while (begin != end) {
+      uint32_t count = 0;
+      for (; count < BATCH_WIDTH && begin != end; ++count, ++begin) {
+        keys[count] = begin;
+        nodes[count] = root_;
+        lanes[count] = count;
+      }
+      uint32_t active = root_ == nullptr ? 0 : count;
+      while (active > 0) {
+        uint32_t remaining = 0;
+        for (uint32_t i = 0; i < active; ++i) {
+          uint32_t j = lanes[i];
+          NodeType* node = nodes[j];
+          int delta = compare(node->value(), *keys[j]);
+          if (delta == 0) {
+            continue;
+          }
+          node = delta < 0 ? node->right() : node->left();
+          nodes[j] = node;
+          if (node != nullptr) {
+            prefetch(node);
+            lanes[remaining++] = j;
+          }
+        }
+        active = remaining;
+      }
+      for (uint32_t j = 0; j < count; ++j) {
+        consume(nodes[j]);
+      }
+    }
+  }
+
+  template<class K>
+  inline NodeType* get_node_impl(const K& value) const {
     NodeType* node = root_;
     while (node != nullptr) {
-      int delta = compare_(node->value(), value);
+      int delta = compare(node->value(), value);
       if (delta < 0) {
         node = node->right();
       } else if (delta > 0) {
@@ -527,90 +2590,233 @@ private:
     return temp;
   }
 
-  inline NodeType* predecessor_impl(const Node<T>* node) const {
-    return predecessor_internal(node);
+  template<class N>
+  inline NodeType* predecessor_impl(const N* node) const {
+    return predecessor_internal(node);
+  }
+
+  inline NodeType* predecessor_impl(const LinkedNode<T>* node) const {
+    return const_cast<NodeType*>(node)->predecessor();
+  }
+
+  inline NodeType* successor_internal(const NodeType* node) const {
+    if (node == nullptr) {
+      return nullptr;
+    }
+    NodeType* result = const_cast<NodeType*>(node);
+    if (result->right() != nullptr) {
+      result = result->right();
+      while (result->left() != nullptr)
+        result = result->left();
+      return result;
+    }
+    NodeType* temp = result->parent();
+    while (temp != nullptr && node == temp->right()) {
+      node = temp;
+      temp = temp->parent();
+    }
+    return temp;
+  }
+
+  template<class N>
+  inline NodeType* successor_impl(const N* node) const {
+    return successor_internal(node);
+  }
+
+  inline NodeType* successor_impl(const LinkedNode<T>* node) const {
+    return const_cast<NodeType*>(node)->successor();
+  }
+
+  template<class N>
+  inline void post_delete(N* node) {
+    // no op
+  }
+
+  inline void post_delete(LinkedNode<T>* linkedNode) {
+    if (linkedNode->predecessor() != nullptr) {
+      linkedNode->predecessor()->set_successor(linkedNode->successor());
+    }
+    if (linkedNode->successor() != nullptr) {
+      linkedNode->successor()->set_predecessor(linkedNode->predecessor());
+    }
+  }
+
+  template<class N>
+  inline void link_in_order(N* previous, N* node) {
+    // no op
+  }
+
+  /**
+   * Thread the specified nodes, either of which may be null, as adjacent in
+   * order.
+   */
+  inline void link_in_order(LinkedNode<T>* previous, LinkedNode<T>* node) {
+    if (previous != nullptr) {
+      previous->set_successor(node);
+    }
+    if (node != nullptr) {
+      node->set_predecessor(previous);
+    }
+  }
+
+  template<class N>
+  static inline N* threaded_predecessor(N* node) {
+    return nullptr;
+  }
+
+  static inline LinkedNode<T>* threaded_predecessor(LinkedNode<T>* node) {
+    return node->predecessor();
+  }
+
+  template<class N>
+  static inline N* threaded_successor(N* node) {
+    return nullptr;
+  }
+
+  static inline LinkedNode<T>* threaded_successor(LinkedNode<T>* node) {
+    return node->successor();
+  }
+
+  template<class N>
+  inline void update(N* node) {
+    // no op
+  }
+
+  /**
+   * Recompute the subtree size stored at the specified node from its children.
+   */
+  inline void update(OrderStatisticNode<T>* node) {
+    node->set_size(1 + subtree_size(node->left()) + subtree_size(node->right()));
+  }
+
+  /**
+   * Recompute the aggregate stored at the specified node from its children.
+   */
+  template<class P>
+  inline void update(AugmentedNode<T, P>* node) {
+    node->set_aggregate(P::combine(P::combine(aggregate_of(node->left()), P::lift(node->value())),
+        aggregate_of(node->right())));
+  }
+
+  template<class N>
+  inline void update_path(N* node) {
+    // no op
   }
 
-  inline NodeType* predecessor_impl(const LinkedNode<T>* node) const {
-    return const_cast<NodeType*>(node)->predecessor();
+  /**
+   * Recompute the subtree sizes stored along the path from the specified node
+   * to the root.
+   */
+  inline void update_path(OrderStatisticNode<T>* node) {
+    while (node != nullptr) {
+      update(node);
+      node = node->parent();
+    }
   }
 
-  inline NodeType* successor_internal(const NodeType* node) const {
-    if (node == nullptr) {
-      return nullptr;
-    }
-    NodeType* result = const_cast<NodeType*>(node);
-    if (result->right() != nullptr) {
-      result = result->right();
-      while (result->left() != nullptr)
-        result = result->left();
-      return result;
-    }
-    NodeType* temp = result->parent();
-    while (temp != nullptr && node == temp->right()) {
-      node = temp;
-      temp = temp->parent();
+  /**
+   * Recompute the aggregates stored along the path from the specified node to
+   * the root.
+   */
+  template<class P>
+  inline void update_path(AugmentedNode<T, P>* node) {
+    while (node != nullptr) {
+      update(node);
+      node = node->parent();
     }
-    return temp;
   }
 
-  inline NodeType* successor_impl(const Node<T>* node) const {
-    return successor_internal(node);
+  template<class N>
+  static inline uint32_t occurrences(const N* node) {
+    return 1;
   }
 
-  inline NodeType* successor_impl(const LinkedNode<T>* node) const {
-    return const_cast<NodeType*>(node)->successor();
+  static inline uint32_t occurrences(const MultiNode<T>* node) {
+    return node->count();
   }
 
-  inline void post_insert(Node<T>* node) {
-    // no op
+  /**
+   * Count one more occurrence of the value of the specified node, if the node
+   * type counts occurrences.
+   *
+   * @return true if the occurrence was counted, false otherwise.
+   */
+  template<class N>
+  static inline bool add_occurrence(N* node) {
+    return false;
   }
 
-  inline void post_insert(LinkedNode<T>* linkedNode) {
-    NodeType* pred = predecessor_internal(linkedNode);
-    linkedNode->set_predecessor(pred);
-    if (pred != nullptr) {
-      pred->set_successor(linkedNode);
-    }
-    NodeType* succ = successor_internal(linkedNode);
-    linkedNode->set_successor(succ);
-    if (succ != nullptr) {
-      succ->set_predecessor(linkedNode);
-    }
+  static inline bool add_occurrence(MultiNode<T>* node) {
+    node->set_count(node->count() + 1);
+    return true;
   }
 
-  inline void post_delete(Node<T>* node) {
-    // no op
+  /**
+   * Count one occurrence less of the value of the specified node, if the node
+   * type counts occurrences and more than one remains.
+   *
+   * @return true if the occurrence was uncounted, false if the node itself must
+   *         be removed.
+   */
+  template<class N>
+  static inline bool remove_occurrence(N* node) {
+    return false;
   }
 
-  inline void post_delete(LinkedNode<T>* linkedNode) {
-    if (linkedNode->predecessor() != nullptr) {
-      linkedNode->predecessor()->set_successor(linkedNode->successor());
-    }
-    if (linkedNode->successor() != nullptr) {
-      linkedNode->successor()->set_predecessor(linkedNode->predecessor());
+  static inline bool remove_occurrence(MultiNode<T>* node) {
+    if (node->count() == 1) {
+      return false;
     }
+    node->set_count(node->count() - 1);
+    return true;
+  }
+
+  /**
+   * Add the occurrences of the specified node, about to be discarded as a
+   * duplicate, to those of the specified node holding the same value, if the
+   * node type counts occurrences.
+   *
+   * @return true if the occurrences were added, false otherwise.
+   */
+  template<class N>
+  static inline bool merge_occurrences(N* kept, const N* discarded) {
+    return false;
+  }
+
+  static inline bool merge_occurrences(MultiNode<T>* kept, const MultiNode<T>* discarded) {
+    kept->set_count(kept->count() + discarded->count());
+    return true;
   }
 
-  inline void post_exchange_values(Node<T>* n, Node<T>* successor) {
+  /**
+   * Give the specified node, which has taken over the value of the specified
+   * source node, the occurrences of the source.
+   */
+  template<class N>
+  static inline void transfer_occurrences(N* node, const N* source) {
     // no op
   }
 
-  inline void post_exchange_values(LinkedNode<T>* linkedNode,
-      LinkedNode<T>* linkedSuccessor) {
-    linkedNode->set_successor(linkedSuccessor->successor());
-    if (linkedNode->successor() != nullptr) {
-      linkedNode->successor()->set_predecessor(linkedNode);
-    }
-    linkedSuccessor->set_predecessor(nullptr);
-    linkedSuccessor->set_successor(nullptr);
+  static inline void transfer_occurrences(MultiNode<T>* node, const MultiNode<T>* source) {
+    node->set_count(source->count());
+  }
+
+  static inline uint32_t subtree_size(const NodeType* node) {
+    return node == nullptr ? 0 : node->size();
+  }
+
+  template<class P>
+  static inline typename P::value_type aggregate_of(const AugmentedNode<T, P>* node) {
+    return node == nullptr ? P::identity() : node->aggregate();
   }
 };
 
 template<class T>
 class Node {
 public:
-  Node(T value) : color_(BLACK), left_(nullptr), right_(nullptr), parent_(nullptr), value_(value) {}
+  template<class... Args>
+  explicit Node(Args&&... args) : color_(BLACK), left_(nullptr), right_(nullptr), parent_(nullptr),
+      value_(std::forward<Args>(args)...) {}
 
   NodeColor color() const {
     return color_;
@@ -667,22 +2873,21 @@ private:
     parent_ = node;
   }
 
-  void set_value(const T& value) {
-    value_ = value;
-  }
-
   void set_color(NodeColor color) {
     color_ = color;
   }
 
-  friend class RedBlackTree<T, Node>;
+  template<class, class, class, class>
+  friend class RedBlackTree;
 };
 
 template<class T>
 class LinkedNode {
 public:
-  LinkedNode(T value) : color_(BLACK), left_(nullptr), right_(nullptr), parent_(nullptr), value_(value),
-      successor_(nullptr), predecessor_(nullptr) {}
+  template<class... Args>
+  explicit LinkedNode(Args&&... args) : color_(BLACK), left_(nullptr), right_(nullptr),
+      parent_(nullptr), value_(std::forward<Args>(args)...), successor_(nullptr),
+      predecessor_(nullptr) {}
 
   NodeColor color() const {
     return color_;
@@ -757,10 +2962,6 @@ private:
     parent_ = node;
   }
 
-  void set_value(const T& value) {
-    value_ = value;
-  }
-
   void set_color(NodeColor color) {
     color_ = color;
   }
@@ -773,5 +2974,295 @@ private:
     predecessor_ = node;
   }
 
-  friend class RedBlackTree<T, LinkedNode>;
+  template<class, class, class, class>
+  friend class RedBlackTree;
+};
+
+template<class T>
+class OrderStatisticNode {
+public:
+  template<class... Args>
+  explicit OrderStatisticNode(Args&&... args) : color_(BLACK), left_(nullptr), right_(nullptr),
+      parent_(nullptr), value_(std::forward<Args>(args)...), size_(1) {}
+
+  NodeColor color() const {
+    return color_;
+  }
+
+  OrderStatisticNode* left() {
+    return left_;
+  }
+
+  const OrderStatisticNode* left() const {
+    return left_;
+  }
+
+  OrderStatisticNode* right() {
+    return right_;
+  }
+
+  const OrderStatisticNode* right() const {
+    return right_;
+  }
+
+  OrderStatisticNode* parent() {
+    return parent_;
+  }
+
+  const OrderStatisticNode* parent() const {
+    return parent_;
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+  bool is_leaf() const {
+    return left_ == nullptr && right_ == nullptr;
+  }
+
+  /**
+   * @return the number of nodes in the subtree rooted at this node.
+   */
+  uint32_t size() const {
+    return size_;
+  }
+
+private:
+  NodeColor color_;
+  OrderStatisticNode* left_;
+  OrderStatisticNode* right_;
+  OrderStatisticNode* parent_;
+  T value_;
+  uint32_t size_;
+
+  void set_left(OrderStatisticNode* node) {
+    left_ = node;
+  }
+
+  void set_right(OrderStatisticNode* node) {
+    right_ = node;
+  }
+
+  void set_parent(OrderStatisticNode* node) {
+    parent_ = node;
+  }
+
+  void set_color(NodeColor color) {
+    color_ = color;
+  }
+
+  void set_size(uint32_t size) {
+    size_ = size;
+  }
+
+  template<class, class, class, class>
+  friend class RedBlackTree;
+};
+
+/**
+ * A node that maintains an aggregate of the values of its subtree, combined in
+ * order under an associative operation with an identity (a monoid), such as a
+ * sum, a minimum or a maximum. The aggregate is defined by a Policy providing
+ *
+ * <pre>
+ * typedef ... value_type;
+ * static value_type identity();
+ * static value_type lift(const T& value);
+ * static value_type combine(const value_type& left, const value_type& right);
+ * </pre>
+ *
+ * where lift maps a single value to its aggregate. A {@link RedBlackTree} of
+ * AugmentedNodes keeps the aggregates up to date through every modification
+ * and answers {@link RedBlackTree#aggregate} queries over ranges of values.
+ */
+template<class T, class Policy>
+class AugmentedNode {
+public:
+  typedef Policy policy_type;
+  typedef typename Policy::value_type aggregate_type;
+
+  template<class... Args>
+  explicit AugmentedNode(Args&&... args) : color_(BLACK), left_(nullptr), right_(nullptr),
+      parent_(nullptr), value_(std::forward<Args>(args)...), aggregate_(Policy::lift(value_)) {}
+
+  NodeColor color() const {
+    return color_;
+  }
+
+  AugmentedNode* left() {
+    return left_;
+  }
+
+  const AugmentedNode* left() const {
+    return left_;
+  }
+
+  AugmentedNode* right() {
+    return right_;
+  }
+
+  const AugmentedNode* right() const {
+    return right_;
+  }
+
+  AugmentedNode* parent() {
+    return parent_;
+  }
+
+  const AugmentedNode* parent() const {
+    return parent_;
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+  bool is_leaf() const {
+    return left_ == nullptr && right_ == nullptr;
+  }
+
+  /**
+   * @return the aggregate of the values in the subtree rooted at this node.
+   */
+  const aggregate_type& aggregate() const {
+    return aggregate_;
+  }
+
+private:
+  NodeColor color_;
+  AugmentedNode* left_;
+  AugmentedNode* right_;
+  AugmentedNode* parent_;
+  T value_;
+  aggregate_type aggregate_;
+
+  void set_left(AugmentedNode* node) {
+    left_ = node;
+  }
+
+  void set_right(AugmentedNode* node) {
+    right_ = node;
+  }
+
+  void set_parent(AugmentedNode* node) {
+    parent_ = node;
+  }
+
+  void set_color(NodeColor color) {
+    color_ = color;
+  }
+
+  void set_aggregate(const aggregate_type& aggregate) {
+    aggregate_ = aggregate;
+  }
+
+  template<class, class, class, class>
+  friend class RedBlackTree;
 };
+
+/**
+ * A node that counts the occurrences of its value, so that a {@link
+ * RedBlackTree} of MultiNodes is a multiset: inserting a value already present
+ * and removing one occurrence of a value present more than once only adjust the
+ * count, without allocation or rebalancing. The count fits into the padding
+ * that follows the color on 64-bit targets, so a MultiNode is no larger than a
+ * {@link Node}. Size and iteration count each distinct value once; {@link
+ * RedBlackTree#count} gives the number of occurrences.
+ */
+template<class T>
+class MultiNode {
+public:
+  template<class... Args>
+  explicit MultiNode(Args&&... args) : color_(BLACK), count_(1), left_(nullptr), right_(nullptr),
+      parent_(nullptr), value_(std::forward<Args>(args)...) {}
+
+  NodeColor color() const {
+    return color_;
+  }
+
+  MultiNode* left() {
+    return left_;
+  }
+
+  const MultiNode* left() const {
+    return left_;
+  }
+
+  MultiNode* right() {
+    return right_;
+  }
+
+  const MultiNode* right() const {
+    return right_;
+  }
+
+  MultiNode* parent() {
+    return parent_;
+  }
+
+  const MultiNode* parent() const {
+    return parent_;
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+  bool is_leaf() const {
+    return left_ == nullptr && right_ == nullptr;
+  }
+
+  /**
+   * @return the number of occurrences of the value of this node.
+   */
+  uint32_t count() const {
+    return count_;
+  }
+
+private:
+  NodeColor color_;
+  uint32_t count_;
+  MultiNode* left_;
+  MultiNode* right_;
+  MultiNode* parent_;
+  T value_;
+
+  void set_left(MultiNode* node) {
+    left_ = node;
+  }
+
+  void set_right(MultiNode* node) {
+    right_ = node;
+  }
+
+  void set_parent(MultiNode* node) {
+    parent_ = node;
+  }
+
+  void set_color(NodeColor color) {
+    color_ = color;
+  }
+
+  void set_count(uint32_t count) {
+    count_ = count;
+  }
+
+  template<class, class, class, class>
+  friend class RedBlackTree;
+};
+
+#ifdef NODE_POOL_HAS_PMR
+/**
+ * A RedBlackTree whose nodes come from a std::pmr::memory_resource. With a
+ * std::pmr::monotonic_buffer_resource, for example a per-request arena, a tree
+ * that is the sole owner of its pool is torn down without handing storage back
+ * piecemeal: neither the nodes, unless their values need destruction, nor the
+ * chunks of the pool are visited, and the storage is reclaimed by releasing
+ * the resource, which must outlive the tree.
+ */
+template<class T, class NodeType = Node<T>, class Compare = int (*)(const T&, const T&)>
+using PmrRedBlackTree = RedBlackTree<T, NodeType, Compare, PmrNodePool<NodeType>>;
+#endif
+
+#undef RED_BLACK_TREE_COUNT
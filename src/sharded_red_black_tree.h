@@ -0,0 +1,337 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+#include "red_black_tree.h"
+
+/**
+ * A red-black tree for write-heavy concurrent use, partitioned by value range
+ * into shards, each a {@link RedBlackTree} with its own lock, so that writers
+ * touching different ranges proceed in parallel.
+ * <p>
+ * A directory of split points maps each value to its shard. Operations on a
+ * single value hold the directory lock shared and the lock of one shard. The
+ * directory lock is striped: each thread takes a reader-writer lock of its own
+ * stripe, on a cache line of its own, and each shard keeps its own count of
+ * values, so that concurrent operations on different shards share no memory
+ * that they write. The split points follow the observed distribution of
+ * values: a shard that grows beyond the shard capacity is split at its median,
+ * and a shard that shrinks below a quarter of it is joined with a neighbour
+ * when the two together fill at most half of it. Rebalancing holds every
+ * stripe of the directory lock exclusively, stalling all operations; a split
+ * costs time linear in the size of the shard, amortized over the insertions
+ * that filled it.
+ * <p>
+ * Scans visit the shards they cover in ascending order, locking one shard at a
+ * time, so that a scan delays only the writers to the shard it is visiting.
+ * Each shard is observed at a single point in time, but the scan as a whole is
+ * not a snapshot: a value inserted or removed concurrently in a shard not yet
+ * visited may or may not be seen.
+ */
+template<class T, class Compare = int (*)(const T&, const T&)>
+class ShardedRedBlackTree {
+public:
+  typedef RedBlackTree<T, Node<T>, Compare> Tree;
+
+  static const uint32_t DEFAULT_SHARD_CAPACITY = 1 << 14;
+
+  /**
+   * @param compare
+   *            the comparator of values.
+   * @param shard_capacity
+   *            the number of values beyond which a shard is split.
+   */
+  explicit ShardedRedBlackTree(const Compare& compare = Compare(),
+      uint32_t shard_capacity = DEFAULT_SHARD_CAPACITY)
+      : compare_(compare), shard_capacity_(shard_capacity < 4 ? 4 : shard_capacity) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard(Tree(compare_))));
+  }
+
+  ShardedRedBlackTree(const ShardedRedBlackTree&) = delete;
+  ShardedRedBlackTree& operator=(const ShardedRedBlackTree&) = delete;
+
+  /**
+   * Insert the specified value into this tree.
+   *
+   * @param value
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
+   */
+  bool insert(const T& value) {
+    bool inserted;
+    bool oversized;
+    {
+      std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+      Shard& shard = *shards_[shard_index(value)];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      inserted = shard.tree.insert(value);
+      shard.update_size();
+      oversized = shard.tree.size() > shard_capacity_;
+    }
+    if (oversized) {
+      split_shard(value);
+    }
+    return inserted;
+  }
+
+  /**
+   * Remove the specified value from this tree.
+   *
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
+   */
+  bool remove(const T& value) {
+    bool removed;
+    bool undersized;
+    {
+      std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+      Shard& shard = *shards_[shard_index(value)];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      removed = shard.tree.remove(value);
+      shard.update_size();
+      undersized = shards_.size() > 1 && shard.tree.size() < shard_capacity_ / 4;
+    }
+    if (removed && undersized) {
+      join_shard(value);
+    }
+    return removed;
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  template<class K>
+  bool contains(const K& value) const {
+    std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+    const Shard& shard = *shards_[shard_index(value)];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.tree.contains(value);
+  }
+
+  /**
+   * Apply the specified function to each value v of this tree with lo <= v <=
+   * hi, in order. Each shard is scanned under its own lock, one at a time, so
+   * the function should not itself modify this tree; rebalancing waits for the
+   * scan to finish.
+   */
+  template<class K, class Function>
+  void for_each_in_range(const K& lo, const K& hi, Function function) const {
+    std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+    size_t first = shard_index(lo);
+    size_t last = shard_index(hi);
+    for (size_t j = first; j <= last; j++) {
+      std::lock_guard<std::mutex> lock(shards_[j]->mutex);
+      shards_[j]->tree.for_each_in_range(lo, hi, function);
+    }
+  }
+
+  /**
+   * Apply the specified function to each value of this tree, in order, with
+   * each shard scanned under its own lock, one at a time.
+   */
+  template<class Function>
+  void for_each(Function function) const {
+    std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+    for (size_t j = 0; j < shards_.size(); j++) {
+      std::lock_guard<std::mutex> lock(shards_[j]->mutex);
+      for (const T& value : shards_[j]->tree) {
+        function(value);
+      }
+    }
+  }
+
+  /**
+   * @return the number of values in this tree, the sum of the counts of the
+   *         shards, which is exact when no modification is in progress.
+   */
+  uint32_t size() const {
+    std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+    uint32_t result = 0;
+    for (size_t j = 0; j < shards_.size(); j++) {
+      result += shards_[j]->size.load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  /**
+   * @return the number of shards into which this tree is partitioned.
+   */
+  size_t shard_count() const {
+    std::shared_lock<std::shared_timed_mutex> directory(directory_stripe());
+    return shards_.size();
+  }
+
+private:
+  struct alignas(64) Shard {
+    mutable std::mutex mutex;
+    Tree tree;
+    // The size of the tree, written under the mutex and read without it.
+    std::atomic<uint32_t> size;
+
+    explicit Shard(Tree&& tree) : tree(std::move(tree)), size(0) {
+      update_size();
+    }
+
+    void update_size() {
+      size.store(tree.size(), std::memory_order_relaxed);
+    }
+  };
+
+  // The number of stripes of the directory lock, among which threads are
+  // spread round robin.
+  static const size_t DIRECTORY_STRIPES = 16;
+
+  struct alignas(64) DirectoryStripe {
+    std::shared_timed_mutex mutex;
+  };
+
+  /**
+   * Holds every stripe of the directory lock exclusively, locking them in
+   * ascending order.
+   */
+  class DirectoryLock {
+  public:
+    explicit DirectoryLock(DirectoryStripe* stripes) : stripes_(stripes) {
+      for (size_t j = 0; j < DIRECTORY_STRIPES; j++) {
+        stripes_[j].mutex.lock();
+      }
+    }
+
+    DirectoryLock(const DirectoryLock&) = delete;
+    DirectoryLock& operator=(const DirectoryLock&) = delete;
+
+    ~DirectoryLock() {
+      for (size_t j = DIRECTORY_STRIPES; j > 0; j--) {
+        stripes_[j - 1].mutex.unlock();
+      }
+    }
+
+  private:
+    DirectoryStripe* stripes_;
+  };
+
+  Compare compare_;
+  uint32_t shard_capacity_;
+  mutable DirectoryStripe directory_[DIRECTORY_STRIPES];
+  // Shard j holds the values v with bounds_[j - 1] <= v < bounds_[j].
+  std::vector<T> bounds_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  /**
+   * @return the stripe of the directory lock of the calling thread.
+   */
+  std::shared_timed_mutex& directory_stripe() const {
+    static std::atomic<size_t> next_stripe(0);
+    static thread_local size_t stripe =
+        next_stripe.fetch_add(1, std::memory_order_relaxed) % DIRECTORY_STRIPES;
+    return directory_[stripe].mutex;
+  }
+
+  /**
+   * @return the index of the shard responsible for the specified key, the
+   *         number of split points not greater than it. Called under the
+   *         directory lock.
+   */
+  template<class K>
+  size_t shard_index(const K& key) const {
+    size_t lo = 0;
+    size_t hi = bounds_.size();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (three_way_compare(compare_, bounds_[mid], key) <= 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  /**
+   * Split the shard responsible for the specified value at its median if it is
+   * still oversized. The upper half is copied into a tree with a pool of its
+   * own, since pools are not shared between shards that are locked
+   * independently.
+   */
+  void split_shard(const T& value) {
+    DirectoryLock directory(directory_);
+    size_t index = shard_index(value);
+    Tree& tree = shards_[index]->tree;
+    if (tree.size() <= shard_capacity_) {
+      return;
+    }
+    typename Tree::const_iterator median = tree.begin();
+    std::advance(median, tree.size() / 2);
+    T bound = *median;
+    std::unique_ptr<Shard> upper;
+    {
+      Tree values = tree.split(bound);
+      upper.reset(new Shard(Tree(values.begin(), values.end(), compare_)));
+    }
+    shards_[index]->update_size();
+    bounds_.insert(bounds_.begin() + index, bound);
+    shards_.insert(shards_.begin() + index + 1, std::move(upper));
+  }
+
+  /**
+   * Join the shard responsible for the specified value with its smaller
+   * neighbour if it is still undersized and the two fill at most half of the
+   * shard capacity.
+   */
+  void join_shard(const T& value) {
+    DirectoryLock directory(directory_);
+    if (shards_.size() == 1) {
+      return;
+    }
+    size_t index = shard_index(value);
+    if (shards_[index]->tree.size() >= shard_capacity_ / 4) {
+      return;
+    }
+    size_t left = index;
+    if (index + 1 == shards_.size() || (index > 0
+        && shards_[index - 1]->tree.size() < shards_[index + 1]->tree.size())) {
+      left = index - 1;
+    }
+    if (shards_[left]->tree.size() + shards_[left + 1]->tree.size() > shard_capacity_ / 2) {
+      return;
+    }
+    shards_[left]->tree.join(std::move(shards_[left + 1]->tree));
+    shards_[left]->update_size();
+    bounds_.erase(bounds_.begin() + left);
+    shards_.erase(shards_.begin() + left + 1);
+  }
+};
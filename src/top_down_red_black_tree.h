@@ -0,0 +1,417 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "node_pool.h"
+#include "red_black_tree.h"
+
+/**
+ * The links of a {@link TopDownNode}: a left and a right child and no parent.
+ * The color of the node is packed into the low bit of the left link, which is
+ * free since nodes are aligned to at least two bytes.
+ */
+class TopDownLinks {
+public:
+  TopDownLinks() : left_(0), right_(nullptr) {}
+
+  NodeColor color() const {
+    return (left_ & RED_BIT) != 0 ? RED : BLACK;
+  }
+
+protected:
+  static const uintptr_t RED_BIT = 1;
+
+  uintptr_t left_;
+  TopDownLinks* right_;
+
+  TopDownLinks* link(int dir) const {
+    return dir == 0 ? reinterpret_cast<TopDownLinks*>(left_ & ~RED_BIT) : right_;
+  }
+
+  void set_link(int dir, TopDownLinks* node) {
+    if (dir == 0) {
+      left_ = reinterpret_cast<uintptr_t>(node) | (left_ & RED_BIT);
+    } else {
+      right_ = node;
+    }
+  }
+
+  void set_color(NodeColor color) {
+    left_ = (left_ & ~RED_BIT) | (color == RED ? RED_BIT : 0);
+  }
+
+  template<class, class>
+  friend class TopDownRedBlackTree;
+};
+
+/**
+ * A node of a {@link TopDownRedBlackTree}, two words smaller than a {@link
+ * Node}: it has no parent link and no separate color field.
+ */
+template<class T>
+class TopDownNode : public TopDownLinks {
+public:
+  template<class... Args>
+  explicit TopDownNode(Args&&... args) : value_(std::forward<Args>(args)...) {}
+
+  const TopDownNode* left() const {
+    return static_cast<const TopDownNode*>(link(0));
+  }
+
+  const TopDownNode* right() const {
+    return static_cast<const TopDownNode*>(link(1));
+  }
+
+  const T& value() const {
+    return value_;
+  }
+
+private:
+  T value_;
+
+  template<class, class>
+  friend class TopDownRedBlackTree;
+};
+
+/**
+ * A red-black tree whose nodes carry no parent links, maintained by single-pass
+ * top-down insertion and deletion: on the way down from the root, colors are
+ * flipped and nodes rotated so that the node at which the search ends can be
+ * linked in or unlinked without a second, upward pass. Compared with {@link
+ * RedBlackTree}, nodes are smaller, so more of the tree fits in cache, and
+ * each modification touches only the nodes of a single root-to-leaf path.
+ * <p>
+ * Without parent links, in-order traversal keeps a stack of the ancestors of
+ * the current node, so the tree offers for_each and for_each_in_range rather
+ * than iterators. Deletion of a node with two children moves the value of its
+ * in-order predecessor into it, so T must be move-assignable and values do not
+ * keep their nodes.
+ *
+ * @see Guibas and Sedgewick. A Dichromatic Framework for Balanced Trees. FOCS
+ *      1978.
+ */
+template<class T, class Compare = int (*)(const T&, const T&)>
+class TopDownRedBlackTree {
+public:
+  typedef TopDownNode<T> NodeType;
+
+  explicit TopDownRedBlackTree(const Compare& compare = Compare())
+      : compare_(compare), root_(nullptr), size_(0) {}
+
+  TopDownRedBlackTree(const TopDownRedBlackTree&) = delete;
+  TopDownRedBlackTree& operator=(const TopDownRedBlackTree&) = delete;
+
+  ~TopDownRedBlackTree() {
+    clear();
+  }
+
+  /**
+   * Insert the specified value into this tree.
+   *
+   * @param value
+   *            the value to insert.
+   * @return true if the value was inserted to this tree, false otherwise.
+   */
+  bool insert(const T& value) {
+    if (root_ == nullptr) {
+      root_ = pool_.allocate(value);
+      ++size_;
+      return true;
+    }
+    bool inserted = false;
+    // A false root above the real one gives the rotations a uniform parent.
+    TopDownLinks head;
+    head.set_link(1, root_);
+    TopDownLinks* t = &head;
+    TopDownLinks* g = nullptr;
+    TopDownLinks* p = nullptr;
+    TopDownLinks* q = root_;
+    int dir = 0;
+    int last = 0;
+    for (;;) {
+      if (q == nullptr) {
+        q = pool_.allocate(value);
+        q->set_color(RED);
+        p->set_link(dir, q);
+        inserted = true;
+      } else if (is_red(q->link(0)) && is_red(q->link(1))) {
+        q->set_color(RED);
+        q->link(0)->set_color(BLACK);
+        q->link(1)->set_color(BLACK);
+      }
+      if (is_red(q) && is_red(p)) {
+        // Two reds in a row: rotate at the grandparent.
+        int dir2 = t->link(1) == g ? 1 : 0;
+        t->set_link(dir2, q == p->link(last) ? rotate(g, !last) : rotate_twice(g, !last));
+      }
+      int delta = compare(value_of(q), value);
+      if (delta == 0) {
+        break;
+      }
+      last = dir;
+      dir = delta < 0 ? 1 : 0;
+      if (g != nullptr) {
+        t = g;
+      }
+      g = p;
+      p = q;
+      q = q->link(dir);
+    }
+    root_ = head.link(1);
+    root_->set_color(BLACK);
+    if (inserted) {
+      ++size_;
+    }
+    return inserted;
+  }
+
+  /**
+   * Remove the specified value from this tree.
+   *
+   * @param value
+   *            the value to remove.
+   * @return true if the value was removed from this tree, false otherwise.
+   */
+  bool remove(const T& value) {
+    if (root_ == nullptr) {
+      return false;
+    }
+    // Push a red node down the search path, so that the leaf-level node
+    // finally unlinked is red and its removal breaks no invariant.
+    TopDownLinks head;
+    head.set_link(1, root_);
+    TopDownLinks* q = &head;
+    TopDownLinks* p = nullptr;
+    TopDownLinks* g = nullptr;
+    TopDownLinks* found = nullptr;
+    int dir = 1;
+    while (q->link(dir) != nullptr) {
+      int last = dir;
+      g = p;
+      p = q;
+      q = q->link(dir);
+      int delta = compare(value_of(q), value);
+      if (delta == 0) {
+        found = q;
+      }
+      dir = delta < 0 ? 1 : 0;
+      if (is_red(q) || is_red(q->link(dir))) {
+        continue;
+      }
+      if (is_red(q->link(!dir))) {
+        TopDownLinks* top = rotate(q, dir);
+        p->set_link(last, top);
+        p = top;
+        continue;
+      }
+      TopDownLinks* s = p->link(!last);
+      if (s == nullptr) {
+        continue;
+      }
+      if (!is_red(s->link(!last)) && !is_red(s->link(last))) {
+        p->set_color(BLACK);
+        s->set_color(RED);
+        q->set_color(RED);
+      } else {
+        int dir2 = g->link(1) == p ? 1 : 0;
+        TopDownLinks* top = is_red(s->link(last)) ? rotate_twice(p, last) : rotate(p, last);
+        g->set_link(dir2, top);
+        q->set_color(RED);
+        top->set_color(RED);
+        top->link(0)->set_color(BLACK);
+        top->link(1)->set_color(BLACK);
+      }
+    }
+    if (found != nullptr) {
+      // q is the in-order predecessor of found, or found itself.
+      if (found != q) {
+        node_of(found)->value_ = std::move(node_of(q)->value_);
+      }
+      p->set_link(p->link(1) == q ? 1 : 0, q->link(q->link(0) == nullptr ? 1 : 0));
+      pool_.release(node_of(q));
+      --size_;
+    }
+    root_ = head.link(1);
+    if (root_ != nullptr) {
+      root_->set_color(BLACK);
+    }
+    return found != nullptr;
+  }
+
+  /**
+   * Test whether or not the specified value is an element of this tree.
+   *
+   * @param value
+   *            the query value.
+   * @return true if the specified value is an element of this tree, false
+   *         otherwise.
+   */
+  template<class K>
+  bool contains(const K& value) const {
+    const TopDownLinks* node = root_;
+    while (node != nullptr) {
+      int delta = compare(value_of(node), value);
+      if (delta == 0) {
+        return true;
+      }
+      node = node->link(delta < 0 ? 1 : 0);
+    }
+    return false;
+  }
+
+  /**
+   * Apply the specified function to each value of this tree, in order.
+   */
+  template<class Function>
+  void for_each(Function function) const {
+    const TopDownLinks* stack[MAX_HEIGHT];
+    size_t depth = 0;
+    const TopDownLinks* node = root_;
+    while (node != nullptr || depth != 0) {
+      for (; node != nullptr; node = node->link(0)) {
+        stack[depth++] = node;
+      }
+      node = stack[--depth];
+      function(value_of(node));
+      node = node->link(1);
+    }
+  }
+
+  /**
+   * Apply the specified function to each value v of this tree with lo <= v <=
+   * hi, in order. Runs in time O(log n + k), where k is the number of such
+   * values.
+   */
+  template<class K, class Function>
+  void for_each_in_range(const K& lo, const K& hi, Function function) const {
+    const TopDownLinks* stack[MAX_HEIGHT];
+    size_t depth = 0;
+    // The stack holds the ancestors not less than lo at which the descent to lo
+    // turned left, which are the values to visit after each left subtree.
+    for (const TopDownLinks* node = root_; node != nullptr;) {
+      if (compare(value_of(node), lo) < 0) {
+        node = node->link(1);
+      } else {
+        stack[depth++] = node;
+        node = node->link(0);
+      }
+    }
+    while (depth != 0) {
+      const TopDownLinks* node = stack[--depth];
+      if (compare(value_of(node), hi) > 0) {
+        return;
+      }
+      function(value_of(node));
+      for (node = node->link(1); node != nullptr; node = node->link(0)) {
+        stack[depth++] = node;
+      }
+    }
+  }
+
+  /**
+   * Remove all values from this tree. Nodes are released in a walk that
+   * rotates each left child up until the root has none, which needs neither
+   * parent links nor a stack.
+   */
+  void clear() {
+    TopDownLinks* node = root_;
+    while (node != nullptr) {
+      TopDownLinks* left = node->link(0);
+      if (left == nullptr) {
+        TopDownLinks* right = node->link(1);
+        pool_.release(node_of(node));
+        node = right;
+      } else {
+        node->set_link(0, left->link(1));
+        left->set_link(1, node);
+        node = left;
+      }
+    }
+    root_ = nullptr;
+    size_ = 0;
+  }
+
+  const NodeType* root() const {
+    return node_of(root_);
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+  bool empty() const {
+    return size_ == 0;
+  }
+
+private:
+  // A red-black tree of n nodes has height at most 2 log2(n + 1).
+  static const size_t MAX_HEIGHT = 2 * 32;
+
+  Compare compare_;
+  NodePool<NodeType> pool_;
+  TopDownLinks* root_;
+  uint32_t size_;
+
+  static NodeType* node_of(TopDownLinks* links) {
+    return static_cast<NodeType*>(links);
+  }
+
+  static const NodeType* node_of(const TopDownLinks* links) {
+    return static_cast<const NodeType*>(links);
+  }
+
+  static const T& value_of(const TopDownLinks* links) {
+    return node_of(links)->value_;
+  }
+
+  static bool is_red(const TopDownLinks* node) {
+    return node != nullptr && node->color() == RED;
+  }
+
+  template<class A, class B>
+  int compare(const A& a, const B& b) const {
+    return three_way_compare(compare_, a, b);
+  }
+
+  /**
+   * Rotate the specified node in the specified direction, coloring it red and
+   * the child taking its place black.
+   *
+   * @return the child taking the place of the node.
+   */
+  static TopDownLinks* rotate(TopDownLinks* node, int dir) {
+    TopDownLinks* child = node->link(!dir);
+    node->set_link(!dir, child->link(dir));
+    child->set_link(dir, node);
+    node->set_color(RED);
+    child->set_color(BLACK);
+    return child;
+  }
+
+  static TopDownLinks* rotate_twice(TopDownLinks* node, int dir) {
+    node->set_link(!dir, rotate(node->link(!dir), !dir));
+    return rotate(node, dir);
+  }
+};
@@ -0,0 +1,91 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <functional>
+#include <set>
+#include <vector>
+
+#include "buffered_red_black_tree.h"
+
+typedef BufferedRedBlackTree<int, Node<int>, std::less<int>> Tree;
+
+TEST(BufferedRedBlackTreeReadsSeeBufferedValues) {
+  Tree tree(std::less<int>(), 100);
+  std::set<int> expected;
+  for (int j = 0; j < 3000; j++) {
+    int value = (j * 7919) % 1500;
+    tree.insert(value);
+    expected.insert(value);
+    if (j % 7 == 0) {
+      int removed = (j * 104729) % 1500;
+      ASSERT_EQ(expected.erase(removed) == 1, tree.remove(removed));
+    }
+    if (j % 13 == 0) {
+      for (int k = 0; k < 1500; k += 37) {
+        ASSERT_EQ(expected.count(k) == 1, tree.contains(k));
+      }
+    }
+  }
+  // Batches grow with the tree, to a quarter of its size.
+  ASSERT_GT(tree.buffered_size(), 0u);
+  ASSERT_LTE(tree.buffered_size(), expected.size() / 4 + 100);
+  ASSERT_EQ(expected.size(), tree.size());
+  ASSERT_EQ(0u, tree.buffered_size());
+  ASSERT_TRUE(std::vector<int>(expected.begin(), expected.end())
+      == std::vector<int>(tree.tree().begin(), tree.tree().end()));
+}
+
+TEST(BufferedRedBlackTreeDuplicates) {
+  Tree tree(std::less<int>(), 8);
+  for (int j = 0; j < 5; j++) {
+    tree.insert(1);
+    tree.insert(2);
+  }
+  ASSERT_TRUE(tree.contains(1));
+  ASSERT_TRUE(tree.remove(1));
+  ASSERT_FALSE(tree.contains(1));
+  ASSERT_FALSE(tree.remove(1));
+  ASSERT_EQ(1u, tree.size());
+}
+
+TEST(BufferedRedBlackTreeReinsertAfterRemove) {
+  Tree tree(std::less<int>(), 1000);
+  for (int j = 0; j < 500; j++) {
+    tree.insert(j);
+  }
+  const Tree& view = tree;
+  ASSERT_TRUE(tree.remove(7));
+  ASSERT_FALSE(view.contains(7));
+  ASSERT_FALSE(tree.remove(7));
+  tree.insert(7);
+  ASSERT_TRUE(view.contains(7));
+  ASSERT_TRUE(tree.remove(7));
+  ASSERT_TRUE(tree.remove(8));
+  tree.insert(8);
+  ASSERT_EQ(499u, tree.size());
+  ASSERT_FALSE(tree.tree().contains(7));
+  ASSERT_TRUE(tree.tree().contains(8));
+  // A removal after the merge takes the value out of the tree itself.
+  ASSERT_TRUE(tree.remove(8));
+  ASSERT_FALSE(view.contains(8));
+  ASSERT_EQ(498u, tree.size());
+}
@@ -0,0 +1,165 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include "compact_node.h"
+
+typedef CompactRedBlackTree<int, std::less<int>> Tree;
+
+// Verify the red-black properties and the parent links of the subtree rooted
+// at node, returning its black height.
+static int validate_helper(const CompactNode<int>* node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  if (node->left() != nullptr) {
+    ASSERT_TRUE(node->left()->parent() == node);
+    ASSERT_TRUE(node->left()->value() < node->value());
+  }
+  if (node->right() != nullptr) {
+    ASSERT_TRUE(node->right()->parent() == node);
+    ASSERT_TRUE(node->value() < node->right()->value());
+  }
+  if (node->color() == RED) {
+    ASSERT_TRUE(node->left() == nullptr || node->left()->color() == BLACK);
+    ASSERT_TRUE(node->right() == nullptr || node->right()->color() == BLACK);
+  }
+  int left = validate_helper(node->left());
+  int right = validate_helper(node->right());
+  ASSERT_EQ(left, right);
+  return left + (node->color() == BLACK ? 1 : 0);
+}
+
+static void equals_helper(const std::set<int>& master, const Tree& tree) {
+  ASSERT_EQ(master.size(), tree.size());
+  if (tree.root() != nullptr) {
+    ASSERT_NULL(tree.root()->parent());
+    ASSERT_EQ(BLACK, tree.root()->color());
+  }
+  validate_helper(tree.root());
+  for (int value : master) {
+    ASSERT_TRUE(tree.contains(value));
+  }
+}
+
+TEST(CompactNodeTestLayout) {
+  ASSERT_EQ(16u, sizeof(CompactNode<int>));
+  ASSERT_TRUE(sizeof(CompactNode<int>) * 3 <= sizeof(LinkedNode<int>));
+}
+
+TEST(CompactNodeTestInsertRemove) {
+  std::set<int> master;
+  Tree tree;
+  for (int j = 0; j < 2000; j++) {
+    int value = (j * 7919) % 2003;
+    ASSERT_EQ(master.insert(value).second, tree.insert(value));
+  }
+  equals_helper(master, tree);
+  for (int j = 0; j < 2000; j += 3) {
+    int value = (j * 7919) % 2003;
+    ASSERT_EQ(master.erase(value) == 1, tree.remove(value));
+  }
+  equals_helper(master, tree);
+  ASSERT_FALSE(tree.contains(2003));
+}
+
+TEST(CompactNodeTestSharedPoolGrowth) {
+  // Both halves of a split anchor their roots in the pool, so growing it on
+  // behalf of one keeps the other intact.
+  std::set<int> less;
+  std::set<int> greater;
+  Tree tree;
+  for (int j = 0; j < 100; j++) {
+    tree.insert(j);
+    (j < 50 ? less : greater).insert(j);
+  }
+  Tree upper = tree.split(50);
+  for (int j = 100; j < 5000; j++) {
+    upper.insert(j);
+    greater.insert(j);
+  }
+  equals_helper(less, tree);
+  equals_helper(greater, upper);
+  // The cached extremes are anchored as well.
+  ASSERT_EQ(0, tree.first_node()->value());
+  ASSERT_EQ(49, tree.last_node()->value());
+  ASSERT_EQ(4999, upper.pop_max().value());
+  ASSERT_EQ(4998, upper.last_node()->value());
+  greater.erase(4999);
+  tree.join(std::move(upper));
+  less.insert(greater.begin(), greater.end());
+  equals_helper(less, tree);
+}
+
+TEST(CompactNodeTestAbsorb) {
+  std::set<int> master;
+  Tree a;
+  Tree b;
+  for (int j = 0; j < 3000; j++) {
+    a.insert(2 * j);
+    b.insert(3 * j);
+    master.insert(2 * j);
+    master.insert(3 * j);
+  }
+  a.union_with(std::move(b));
+  equals_helper(master, a);
+  Tree c(master.begin(), master.end());
+  equals_helper(master, c);
+}
+
+TEST(CompactNodeTestRelocation) {
+  // Links are relative, so a bytewise copy of the nodes is a valid tree.
+  std::vector<int> values;
+  for (int j = 0; j < 1000; j++) {
+    values.push_back(j);
+  }
+  Tree tree(values.begin(), values.end());
+  const CompactNode<int>* first = tree.node(0);
+  std::vector<CompactNode<int>> copy(values.size(), CompactNode<int>(0));
+  std::memcpy(static_cast<void*>(copy.data()), first, copy.size() * sizeof(CompactNode<int>));
+  const CompactNode<int>* root = copy.data() + (tree.root() - first);
+  ASSERT_EQ(tree.root()->value(), root->value());
+  validate_helper(root);
+  const CompactNode<int>* node = root;
+  while (node->left() != nullptr) {
+    node = node->left();
+  }
+  for (int j = 0; j < 1000; j++) {
+    ASSERT_EQ(j, node->value());
+    if (node->right() != nullptr) {
+      node = node->right();
+      while (node->left() != nullptr) {
+        node = node->left();
+      }
+    } else {
+      while (node->parent() != nullptr && node == node->parent()->right()) {
+        node = node->parent();
+      }
+      node = node->parent();
+    }
+  }
+  ASSERT_NULL(node);
+}
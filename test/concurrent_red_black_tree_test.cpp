@@ -0,0 +1,95 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "concurrent_red_black_tree.h"
+
+typedef ConcurrentRedBlackTree<int, std::less<int>> Tree;
+
+TEST(ConcurrentRedBlackTreeBasic) {
+  Tree tree;
+  for (int j = 0; j < 100; j++) {
+    ASSERT_TRUE(tree.insert(j));
+    ASSERT_FALSE(tree.insert(j));
+  }
+  ASSERT_EQ(100u, tree.size());
+  ASSERT_TRUE(tree.remove(50));
+  ASSERT_FALSE(tree.remove(50));
+  ASSERT_FALSE(tree.contains(50));
+  ASSERT_TRUE(tree.contains(51));
+  std::vector<int> values;
+  tree.for_each_in_range(45, 55, [&values](int value) { values.push_back(value); });
+  int expected[] = {45, 46, 47, 48, 49, 51, 52, 53, 54, 55};
+  ASSERT_EQ(10u, values.size());
+  ASSERT_ARRAY_EQ(expected, values, 10);
+}
+
+TEST(ConcurrentRedBlackTreeReadersSeeConsistentVersions) {
+  Tree tree;
+  std::atomic<bool> done(false);
+  std::vector<int> failures(4, 0);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.push_back(std::thread([&tree, &done, &failures, t]() {
+      while (!done.load()) {
+        // Values are inserted and removed in pairs, so every version holds an
+        // even number of them.
+        int count = 0;
+        tree.for_each_in_range(0, 1000, [&count](int) { ++count; });
+        if (count % 2 != 0) {
+          ++failures[t];
+        }
+        Tree::Snapshot snapshot = tree.snapshot();
+        for (int j = 0; j < 1000; j += 2) {
+          if (snapshot.contains(j) != snapshot.contains(j + 1)) {
+            ++failures[t];
+          }
+        }
+      }
+    }));
+  }
+  for (int round = 0; round < 3; round++) {
+    for (int j = 0; j < 1000; j += 2) {
+      tree.update([j, round](Tree::Snapshot& writer) {
+        if (round % 2 == 0) {
+          writer.insert(j);
+          writer.insert(j + 1);
+        } else {
+          writer.remove(j);
+          writer.remove(j + 1);
+        }
+      });
+    }
+  }
+  done.store(true);
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  for (int t = 0; t < 4; t++) {
+    ASSERT_EQ(0, failures[t]);
+  }
+  ASSERT_EQ(1000u, tree.size());
+}
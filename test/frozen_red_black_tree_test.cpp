@@ -0,0 +1,174 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "frozen_red_black_tree.h"
+
+TEST(FrozenRedBlackTreeTestSearch) {
+  for (int count = 0; count < 70; count++) {
+    std::vector<int> values;
+    for (int j = 0; j < count; j++) {
+      values.push_back(2 * j);
+    }
+    FrozenRedBlackTree<int, std::less<int>> tree(values.begin(), values.end());
+    ASSERT_EQ(values.size(), tree.size());
+    ASSERT_TRUE(std::equal(values.begin(), values.end(), tree.begin()));
+    for (int key = -1; key <= 2 * count; key++) {
+      ASSERT_EQ(std::binary_search(values.begin(), values.end(), key), tree.contains(key));
+      auto lower = std::lower_bound(values.begin(), values.end(), key);
+      auto upper = std::upper_bound(values.begin(), values.end(), key);
+      if (lower == values.end()) {
+        ASSERT_TRUE(tree.lower_bound(key) == tree.end());
+      } else {
+        ASSERT_EQ(*lower, *tree.lower_bound(key));
+      }
+      if (upper == values.end()) {
+        ASSERT_TRUE(tree.upper_bound(key) == tree.end());
+      } else {
+        ASSERT_EQ(*upper, *tree.upper_bound(key));
+      }
+      ASSERT_EQ(lower != values.end() && *lower == key, tree.find(key) != tree.end());
+    }
+  }
+}
+
+TEST(FrozenRedBlackTreeTestIteration) {
+  std::vector<int> values;
+  for (int j = 0; j < 100; j++) {
+    values.push_back(j);
+  }
+  FrozenRedBlackTree<int, std::less<int>> tree(values.begin(), values.end());
+  std::vector<int> reversed;
+  for (auto iter = tree.end(); iter != tree.begin();) {
+    reversed.push_back(*--iter);
+  }
+  ASSERT_TRUE(std::equal(values.rbegin(), values.rend(), reversed.begin()));
+  auto iter = tree.lower_bound(40);
+  for (int j = 40; j < 100; j++, ++iter) {
+    ASSERT_EQ(j, *iter);
+  }
+  ASSERT_TRUE(iter == tree.end());
+}
+
+TEST(FrozenRedBlackTreeTestFreeze) {
+  RedBlackTree<std::string, Node<std::string>, std::less<std::string>> tree;
+  std::set<std::string> master;
+  for (int j = 0; j < 500; j++) {
+    std::string value = std::to_string((j * 7919) % 1009);
+    tree.insert(value);
+    master.insert(value);
+  }
+  FrozenRedBlackTree<std::string, std::less<std::string>> frozen = tree.freeze();
+  ASSERT_EQ(master.size(), frozen.size());
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), frozen.begin()));
+  for (int j = 0; j < 1009; j++) {
+    std::string key = std::to_string(j);
+    ASSERT_EQ(tree.contains(key), frozen.contains(key));
+  }
+}
+
+TEST(FrozenRedBlackTreeTestImage) {
+  typedef RedBlackTree<int64_t, Node<int64_t>, std::less<int64_t>> Tree;
+  typedef FrozenRedBlackTree<int64_t, std::less<int64_t>> Frozen;
+  Tree tree;
+  for (int64_t j = 0; j < 1000; j++) {
+    tree.insert((j * 7919) % 1009);
+  }
+  std::stringstream stream;
+  tree.save(stream);
+  std::string bytes = stream.str();
+
+  std::vector<int64_t> buffer(bytes.size() / sizeof(int64_t) + 1);
+  std::memcpy(buffer.data(), bytes.data(), bytes.size());
+  Frozen view = Frozen::view(buffer.data(), bytes.size());
+  ASSERT_EQ(tree.size(), view.size());
+  for (int64_t j = 0; j < 1009; j++) {
+    ASSERT_EQ(tree.contains(j), view.contains(j));
+  }
+  Frozen copy = view;
+  ASSERT_TRUE(std::equal(view.begin(), view.end(), copy.begin()));
+
+  Tree loaded;
+  loaded.load(stream);
+  ASSERT_EQ(tree.size(), loaded.size());
+  for (int64_t j = 0; j < 1009; j++) {
+    ASSERT_EQ(tree.contains(j), loaded.contains(j));
+  }
+
+  bool threw = false;
+  try {
+    FrozenRedBlackTree<int32_t, std::less<int32_t>>::view(buffer.data(), bytes.size());
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  ASSERT_TRUE(threw);
+  threw = false;
+  try {
+    Frozen::view(buffer.data(), bytes.size() - 1);
+  } catch (const std::runtime_error&) {
+    threw = true;
+  }
+  ASSERT_TRUE(threw);
+}
+
+TEST(FrozenRedBlackTreeTestCorruptImage) {
+  typedef RedBlackTree<int64_t, Node<int64_t>, std::less<int64_t>> Tree;
+  typedef FrozenRedBlackTree<int64_t, std::less<int64_t>> Frozen;
+  Tree tree;
+  for (int64_t j = 0; j < 100; j++) {
+    tree.insert(j);
+  }
+  std::stringstream stream;
+  tree.save(stream);
+  std::string bytes = stream.str();
+  // The size follows the magic and four 32-bit fields of the header.
+  const size_t size_offset = 24;
+  const uint64_t sizes[] = { UINT64_MAX, UINT64_MAX / sizeof(int64_t), uint64_t(1) << 40, 100 + 1 };
+  for (uint64_t size : sizes) {
+    std::string corrupt = bytes;
+    std::memcpy(&corrupt[size_offset], &size, sizeof(size));
+    std::vector<int64_t> buffer(corrupt.size() / sizeof(int64_t) + 1);
+    std::memcpy(buffer.data(), corrupt.data(), corrupt.size());
+    bool threw = false;
+    try {
+      Frozen::view(buffer.data(), corrupt.size());
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    ASSERT_TRUE(threw);
+    threw = false;
+    try {
+      std::stringstream in(corrupt);
+      Frozen::load(in);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    ASSERT_TRUE(threw);
+  }
+}
@@ -0,0 +1,107 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "interval_tree.h"
+
+static std::vector<Interval<int>> make_intervals(int count) {
+  std::vector<Interval<int>> result;
+  for (int j = 0; j < count; j++) {
+    int lo = (j * 7919) % 1000;
+    result.push_back(Interval<int>(lo, lo + (j * 104729) % 50));
+  }
+  return result;
+}
+
+static std::vector<Interval<int>> brute_force(const std::vector<Interval<int>>& intervals,
+    int lo, int hi) {
+  std::vector<Interval<int>> result;
+  for (const Interval<int>& interval : intervals) {
+    if (interval.lo <= hi && lo <= interval.hi) {
+      result.push_back(interval);
+    }
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+TEST(IntervalTreeTestOverlapping) {
+  std::vector<Interval<int>> intervals = make_intervals(600);
+  IntervalTree<Interval<int>> tree;
+  for (const Interval<int>& interval : intervals) {
+    tree.insert(interval);
+  }
+  for (int lo = -10; lo < 1060; lo += 7) {
+    std::vector<Interval<int>> actual;
+    tree.overlapping(lo, [&actual](const Interval<int>& interval) { actual.push_back(interval); });
+    ASSERT_TRUE(brute_force(intervals, lo, lo) == actual);
+    actual.clear();
+    tree.overlapping(lo, lo + 13, [&actual](const Interval<int>& interval) {
+      actual.push_back(interval);
+    });
+    ASSERT_TRUE(brute_force(intervals, lo, lo + 13) == actual);
+  }
+  // Removal keeps the end bounds up to date.
+  std::vector<Interval<int>> remaining;
+  for (size_t j = 0; j < intervals.size(); j++) {
+    if (j % 3 == 0) {
+      tree.remove(intervals[j]);
+    } else {
+      remaining.push_back(intervals[j]);
+    }
+  }
+  for (int lo = -10; lo < 1060; lo += 11) {
+    std::vector<Interval<int>> actual;
+    tree.overlapping(lo, lo + 5, [&actual](const Interval<int>& interval) {
+      actual.push_back(interval);
+    });
+    ASSERT_TRUE(brute_force(remaining, lo, lo + 5) == actual);
+  }
+}
+
+TEST(IntervalTreeTestBatch) {
+  std::vector<Interval<int>> intervals = make_intervals(1000);
+  std::vector<Interval<int>> sorted = intervals;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  IntervalTree<Interval<int>> tree(sorted.begin(), sorted.end());
+  std::vector<Interval<int>> queries;
+  for (int j = 0; j < 200; j++) {
+    int lo = (j * 31) % 1100 - 20;
+    queries.push_back(Interval<int>(lo, lo + j % 17));
+  }
+  queries.push_back(Interval<int>(10, 5));
+  std::vector<std::vector<Interval<int>>> actual(queries.size());
+  tree.overlapping_batch(queries.begin(), queries.end(),
+      [&actual](size_t index, const Interval<int>& interval) {
+        actual[index].push_back(interval);
+      });
+  for (size_t j = 0; j + 1 < queries.size(); j++) {
+    ASSERT_TRUE(brute_force(intervals, queries[j].lo, queries[j].hi) == actual[j]);
+  }
+  // An empty query overlaps nothing.
+  ASSERT_TRUE(actual.back().empty());
+}
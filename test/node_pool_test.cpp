@@ -0,0 +1,97 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <string>
+#include <vector>
+
+#include "node_pool.h"
+
+TEST(NodePoolReuse) {
+  NodePool<std::string> pool;
+  std::string* first = pool.allocate("first");
+  ASSERT_EQ(std::string("first"), *first);
+  ASSERT_EQ(1u, pool.size());
+  pool.release(first);
+  ASSERT_EQ(0u, pool.size());
+  std::string* second = pool.allocate("second");
+  ASSERT_TRUE(first == second);
+  ASSERT_EQ(std::string("second"), *second);
+  pool.release(second);
+}
+
+TEST(NodePoolGrowth) {
+  NodePool<int> pool;
+  std::vector<int*> objects;
+  for (int j = 0; j < 10000; j++) {
+    objects.push_back(pool.allocate(j));
+  }
+  ASSERT_EQ(10000u, pool.size());
+  size_t capacity = pool.capacity();
+  ASSERT_GTE(capacity, 10000u);
+  for (int j = 0; j < 10000; j++) {
+    ASSERT_EQ(j, *objects[j]);
+    pool.release(objects[j]);
+  }
+  for (int j = 0; j < 10000; j++) {
+    pool.allocate(j);
+  }
+  ASSERT_EQ(capacity, pool.capacity());
+}
+
+TEST(NodePoolReserve) {
+  NodePool<uint64_t> pool;
+  pool.reserve(1000);
+  uint64_t* previous = pool.allocate(0);
+  for (int j = 1; j < 1000; j++) {
+    uint64_t* next = pool.allocate(j);
+    ASSERT_TRUE(next == previous + 1);
+    previous = next;
+  }
+}
+
+#ifdef NODE_POOL_HAS_PMR
+TEST(NodePoolMemoryResource) {
+  char buffer[1 << 14];
+  std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+  PmrNodePool<int> pool{std::pmr::polymorphic_allocator<int>(&arena)};
+  ASSERT_TRUE(pool.monotonic());
+  std::vector<int*> objects;
+  for (int j = 0; j < 100; j++) {
+    objects.push_back(pool.allocate(j));
+  }
+  for (int j = 0; j < 100; j++) {
+    ASSERT_TRUE(static_cast<void*>(objects[j]) >= static_cast<void*>(buffer));
+    ASSERT_TRUE(static_cast<void*>(objects[j]) < static_cast<void*>(buffer + sizeof(buffer)));
+    ASSERT_EQ(j, *objects[j]);
+  }
+  // Pools on different resources cannot exchange storage.
+  std::pmr::unsynchronized_pool_resource other_resource;
+  PmrNodePool<int> other{std::pmr::polymorphic_allocator<int>(&other_resource)};
+  ASSERT_FALSE(other.monotonic());
+  other.allocate(7);
+  ASSERT_FALSE(pool.absorb(other));
+  PmrNodePool<int> same{std::pmr::polymorphic_allocator<int>(&arena)};
+  same.allocate(8);
+  ASSERT_TRUE(pool.absorb(same));
+  ASSERT_EQ(101u, pool.size());
+}
+#endif
@@ -0,0 +1,137 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "persistent_red_black_tree.h"
+
+typedef PersistentRedBlackTree<int, std::less<int>> Tree;
+
+// Verify the red-black properties of the subtree rooted at node, returning its
+// black height.
+static int validate_helper(const PersistentNode<int>* node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  if (node->color() == RED) {
+    ASSERT_TRUE(node->left() == nullptr || node->left()->color() == BLACK);
+    ASSERT_TRUE(node->right() == nullptr || node->right()->color() == BLACK);
+  }
+  int left = validate_helper(node->left());
+  int right = validate_helper(node->right());
+  ASSERT_EQ(left, right);
+  return left + (node->color() == BLACK ? 1 : 0);
+}
+
+static void equals_helper(const std::set<int>& master, const Tree& tree) {
+  ASSERT_EQ(master.size(), tree.size());
+  std::vector<int> values;
+  tree.for_each([&values](int value) { values.push_back(value); });
+  ASSERT_TRUE(std::vector<int>(master.begin(), master.end()) == values);
+  validate_helper(tree.root());
+}
+
+TEST(PersistentRedBlackTreeInsertRemove) {
+  std::set<int> master;
+  Tree tree;
+  for (int j = 0; j < 1000; j++) {
+    int value = (j * 7919) % 1000;
+    ASSERT_TRUE(tree.insert(value));
+    ASSERT_FALSE(tree.insert(value));
+    master.insert(value);
+  }
+  equals_helper(master, tree);
+  for (int j = 0; j < 1000; j += 3) {
+    ASSERT_TRUE(tree.remove(j));
+    ASSERT_FALSE(tree.remove(j));
+    ASSERT_FALSE(tree.contains(j));
+    master.erase(j);
+    validate_helper(tree.root());
+  }
+  equals_helper(master, tree);
+}
+
+TEST(PersistentRedBlackTreeSnapshot) {
+  std::vector<std::set<int>> masters;
+  std::vector<Tree> snapshots;
+  std::set<int> master;
+  Tree tree;
+  for (int j = 0; j < 2000; j++) {
+    int value = (j * 7919) % 500;
+    if (master.count(value) > 0) {
+      tree.remove(value);
+      master.erase(value);
+    } else {
+      tree.insert(value);
+      master.insert(value);
+    }
+    if (j % 100 == 0) {
+      snapshots.push_back(tree.snapshot());
+      masters.push_back(master);
+    }
+  }
+  equals_helper(master, tree);
+  for (size_t j = 0; j < snapshots.size(); j++) {
+    equals_helper(masters[j], snapshots[j]);
+  }
+  Tree copy = snapshots[3];
+  copy.insert(1000);
+  ASSERT_TRUE(copy.contains(1000));
+  ASSERT_FALSE(snapshots[3].contains(1000));
+  equals_helper(masters[3], snapshots[3]);
+}
+
+TEST(PersistentRedBlackTreeConcurrentReaders) {
+  Tree tree;
+  for (int j = 0; j < 1000; j++) {
+    tree.insert(2 * j);
+  }
+  std::vector<std::thread> readers;
+  std::vector<int> failures(4, 0);
+  for (int t = 0; t < 4; t++) {
+    Tree snapshot = tree.snapshot();
+    readers.push_back(std::thread([snapshot, t, &failures]() {
+      for (int round = 0; round < 20; round++) {
+        for (int j = 0; j < 1000; j++) {
+          if (!snapshot.contains(2 * j) || snapshot.contains(2 * j + 1)) {
+            ++failures[t];
+          }
+        }
+      }
+    }));
+  }
+  for (int j = 0; j < 1000; j++) {
+    tree.remove(2 * j);
+    tree.insert(2 * j + 1);
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  for (int t = 0; t < 4; t++) {
+    ASSERT_EQ(0, failures[t]);
+  }
+  ASSERT_EQ(1000u, tree.size());
+  ASSERT_TRUE(tree.contains(1));
+}
@@ -0,0 +1,119 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "red_black_map.h"
+
+TEST(RedBlackMapTestOperations) {
+  RedBlackMap<int, int> map;
+  std::map<int, int> expected;
+  for (int j = 0; j < 2000; j++) {
+    int key = (j * 7919) % 500;
+    map[key] += j;
+    expected[key] += j;
+  }
+  ASSERT_EQ(expected.size(), map.size());
+  for (int j = 0; j < 500; j += 3) {
+    ASSERT_EQ(expected.erase(j) == 1, map.erase(j));
+  }
+  ASSERT_FALSE(map.erase(0));
+  std::map<int, int>::const_iterator e = expected.begin();
+  for (RedBlackMap<int, int>::const_iterator i = map.begin(); i != map.end(); ++i, ++e) {
+    ASSERT_EQ(e->first, i->first);
+    ASSERT_EQ(e->second, i->second);
+  }
+  ASSERT_TRUE(e == expected.end());
+  ASSERT_EQ(expected[1], map.at(1));
+  ASSERT_FALSE(map.contains(3));
+  ASSERT_TRUE(map.find(3) == map.end());
+  ASSERT_EQ(4, map.lower_bound(3)->first);
+  ASSERT_EQ(5, map.upper_bound(4)->first);
+  bool thrown = false;
+  try {
+    map.at(3);
+  } catch (const std::out_of_range&) {
+    thrown = true;
+  }
+  ASSERT_TRUE(thrown);
+}
+
+TEST(RedBlackMapTestInPlaceUpdates) {
+  RedBlackMap<std::string, std::string, std::less<std::string>, LinkedNode> map;
+  std::pair<RedBlackMap<std::string, std::string, std::less<std::string>, LinkedNode>::iterator,
+      bool> result = map.try_emplace("b", 3, 'x');
+  ASSERT_TRUE(result.second);
+  ASSERT_EQ(std::string("xxx"), result.first->second);
+  // An existing entry is left alone.
+  result = map.try_emplace("b", 5, 'y');
+  ASSERT_FALSE(result.second);
+  ASSERT_EQ(std::string("xxx"), result.first->second);
+  ASSERT_TRUE(map.insert_or_assign("a", std::string("first")).second);
+  ASSERT_FALSE(map.insert_or_assign("b", std::string("second")).second);
+  ASSERT_EQ(std::string("second"), map.at("b"));
+  map.find("a")->second += "!";
+  ASSERT_EQ(std::string("first!"), map["a"]);
+  ASSERT_TRUE(map["c"].empty());
+  ASSERT_EQ(3u, map.size());
+  map.clear();
+  ASSERT_TRUE(map.empty());
+}
+
+TEST(RedBlackMapTestMoveOnlyValues) {
+  RedBlackMap<int, std::unique_ptr<int>> map;
+  map.try_emplace(1, new int(10));
+  map.insert_or_assign(2, std::unique_ptr<int>(new int(20)));
+  map.insert_or_assign(1, std::unique_ptr<int>(new int(11)));
+  ASSERT_EQ(11, *map[1]);
+  ASSERT_EQ(20, *map.at(2));
+  ASSERT_TRUE(map[3] == nullptr);
+}
+
+TEST(RedBlackMapTestConstAccess) {
+  typedef RedBlackMap<int, int> Map;
+  Map map;
+  for (int j = 0; j < 10; j++) {
+    map[j] = j;
+  }
+  // Mapped values are modifiable only through a non-const map.
+  static_assert(std::is_same<decltype(std::declval<const Map&>().at(0)), const int&>::value,
+      "const at() must not expose a mutable value");
+  static_assert(std::is_same<decltype(*std::declval<Map::const_iterator>()),
+      const Map::Entry&>::value, "const_iterator must not expose a mutable entry");
+  for (Map::iterator i = map.begin(); i != map.end(); ++i) {
+    i->second *= 2;
+  }
+  map.at(3) += 1;
+  const Map& view = map;
+  int j = 0;
+  for (Map::const_iterator i = view.begin(); i != view.end(); ++i, ++j) {
+    ASSERT_EQ(j, i->first);
+    ASSERT_EQ(j == 3 ? 7 : 2 * j, i->second);
+  }
+  ASSERT_EQ(7, view.at(3));
+  Map::const_iterator found = map.find(4);
+  ASSERT_EQ(8, found->second);
+}
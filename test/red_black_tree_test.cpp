@@ -21,11 +21,46 @@
 #include "test.h"
 
 #include <algorithm>
+#include <iterator>
+#include <memory>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "red_black_tree.h"
 
+// Verify the red-black properties and the parent links of the subtree rooted
+// at node, returning its black height.
+template <typename NodeType>
+static int validate_helper(const NodeType* node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  if (node->left() != nullptr) {
+    ASSERT_TRUE(node->left()->parent() == node);
+  }
+  if (node->right() != nullptr) {
+    ASSERT_TRUE(node->right()->parent() == node);
+  }
+  if (node->color() == RED) {
+    ASSERT_TRUE(node->left() == nullptr || node->left()->color() == BLACK);
+    ASSERT_TRUE(node->right() == nullptr || node->right()->color() == BLACK);
+  }
+  int left = validate_helper(node->left());
+  int right = validate_helper(node->right());
+  ASSERT_EQ(left, right);
+  return left + (node->color() == BLACK ? 1 : 0);
+}
+
+template <typename Tree>
+static void validate_helper(const Tree& tree) {
+  if (tree.root() != nullptr) {
+    ASSERT_NULL(tree.root()->parent());
+    ASSERT_EQ(BLACK, tree.root()->color());
+  }
+  validate_helper(tree.root());
+}
+
 template <typename Collection, typename Tree>
 static void equals_helper(const Collection& master, const Tree& tree) {
   ASSERT_EQ(master.size(), tree.size());
@@ -55,6 +90,7 @@ TEST(RedBlackTreeTestDelete) {
     master.erase(find(master.begin(), master.end(), val));
     tree.remove(val);
     equals_helper(master, tree);
+    validate_helper(tree);
   }
 }
 
@@ -111,3 +147,1012 @@ TEST(RedBlackTreeTestLinkedSuccessor) {
   }
   ASSERT_NULL(tree.successor(tree.node(99)));
 }
+
+TEST(RedBlackTreeTestStringValues) {
+  std::set<std::string> master;
+  RedBlackTree<std::string, LinkedNode<std::string>> tree(
+      [](const std::string& o1, const std::string& o2)->int{return o1.compare(o2);});
+  for (int j = 0; j < 1000; j++) {
+    std::string value = std::to_string((j * 7919) % 1000);
+    tree.insert(value);
+    master.insert(value);
+  }
+  for (int j = 0; j < 1000; j += 3) {
+    std::string value = std::to_string(j);
+    tree.remove(value);
+    master.erase(value);
+  }
+  equals_helper(master, tree);
+}
+
+TEST(RedBlackTreeTestTwoWayComparator) {
+  std::set<int> master;
+  RedBlackTree<int, Node<int>, std::less<int>> tree;
+  for (int j = 0; j < 1000; j++) {
+    int value = (j * 7919) % 1000;
+    ASSERT_TRUE(tree.insert(value));
+    ASSERT_FALSE(tree.insert(value));
+    master.insert(value);
+  }
+  for (int j = 0; j < 1000; j += 3) {
+    ASSERT_TRUE(tree.remove(j));
+    master.erase(j);
+  }
+  equals_helper(master, tree);
+}
+
+struct LengthCompare {
+  typedef void is_transparent;
+
+  int operator()(const std::string& o1, const std::string& o2) const {
+    return static_cast<int>(o1.size()) - static_cast<int>(o2.size());
+  }
+
+  int operator()(const std::string& o1, size_t length) const {
+    return static_cast<int>(o1.size()) - static_cast<int>(length);
+  }
+};
+
+TEST(RedBlackTreeTestHeterogeneousLookup) {
+  RedBlackTree<std::string, Node<std::string>, LengthCompare> tree;
+  for (int j = 1; j < 10; j++) {
+    tree.insert(std::string(j, 'a'));
+  }
+  for (size_t j = 1; j < 10; j++) {
+    ASSERT_TRUE(tree.contains(j));
+    ASSERT_EQ(j, tree.node(j)->value().size());
+  }
+  ASSERT_FALSE(tree.contains(static_cast<size_t>(10)));
+  ASSERT_TRUE(tree.contains(std::string("bbb")));
+}
+
+TEST(RedBlackTreeTestOrderStatistics) {
+  std::set<int> master;
+  RedBlackTree<int, OrderStatisticNode<int>, std::less<int>> tree;
+  for (int j = 0; j < 500; j++) {
+    int value = (j * 7919) % 1000;
+    tree.insert(value);
+    master.insert(value);
+  }
+  for (int j = 0; j < 1000; j += 3) {
+    tree.remove(j);
+    master.erase(j);
+  }
+  validate_helper(tree);
+  ASSERT_EQ(master.size(), tree.root()->size());
+  uint32_t k = 0;
+  for (auto iter = master.begin(); iter != master.end(); ++iter, ++k) {
+    ASSERT_EQ(*iter, tree.select(k)->value());
+    ASSERT_EQ(k, tree.rank(*iter));
+  }
+  ASSERT_NULL(tree.select(k));
+  for (int lo = -1; lo < 1001; lo += 37) {
+    for (int hi = lo - 5; hi < 1001; hi += 101) {
+      uint32_t expected = 0;
+      for (int value : master) {
+        expected += lo <= value && value <= hi;
+      }
+      ASSERT_EQ(expected, tree.count_range(lo, hi));
+    }
+  }
+}
+
+TEST(RedBlackTreeTestBulkLoad) {
+  for (int n = 0; n < 300; n++) {
+    std::vector<int> values;
+    for (int j = 0; j < n; j++) {
+      values.push_back(2 * j);
+    }
+    RedBlackTree<int, LinkedNode<int>, std::less<int>> tree(values.begin(), values.end());
+    validate_helper(tree);
+    equals_helper(values, tree);
+    for (int j = 0; j < n; j++) {
+      const LinkedNode<int>* node = tree.node(2 * j);
+      if (j > 0) {
+        ASSERT_EQ(2 * j - 2, node->predecessor()->value());
+      } else {
+        ASSERT_NULL(node->predecessor());
+      }
+      if (j < n - 1) {
+        ASSERT_EQ(2 * j + 2, node->successor()->value());
+      } else {
+        ASSERT_NULL(node->successor());
+      }
+    }
+    tree.insert(1);
+    tree.remove(0);
+    validate_helper(tree);
+  }
+}
+
+TEST(RedBlackTreeTestBulkLoadOrderStatistics) {
+  std::vector<int> values;
+  for (int j = 0; j < 1000; j++) {
+    values.push_back(j);
+  }
+  RedBlackTree<int, OrderStatisticNode<int>, std::less<int>> tree;
+  tree.insert(5000);
+  tree.assign(values.begin(), values.end());
+  validate_helper(tree);
+  ASSERT_EQ(1000u, tree.size());
+  ASSERT_FALSE(tree.contains(5000));
+  for (int j = 0; j < 1000; j++) {
+    ASSERT_EQ(j, tree.select(j)->value());
+  }
+}
+
+// Verify that the successor and predecessor threads of a tree of LinkedNode
+// visit exactly the elements of master, in order.
+template <typename Collection, typename Tree>
+static void threads_helper(const Collection& master, const Tree& tree) {
+  const LinkedNode<int>* node = tree.root();
+  while (node != nullptr && node->left() != nullptr) {
+    node = node->left();
+  }
+  const LinkedNode<int>* previous = nullptr;
+  for (auto iter = master.begin(); iter != master.end(); ++iter) {
+    ASSERT_EQ(*iter, node->value());
+    ASSERT_TRUE(node->predecessor() == previous);
+    previous = node;
+    node = node->successor();
+  }
+  ASSERT_NULL(node);
+}
+
+TEST(RedBlackTreeTestJoinSplit) {
+  typedef RedBlackTree<int, LinkedNode<int>, std::less<int>> Tree;
+  for (int n = 0; n < 200; n += 7) {
+    for (int key = -1; key <= n + 1; key += 3) {
+      std::vector<int> values;
+      for (int j = 0; j < n; j++) {
+        values.push_back(j);
+      }
+      Tree tree(values.begin(), values.end());
+      Tree greater = tree.split(key);
+      validate_helper(tree);
+      validate_helper(greater);
+      std::set<int> less_master(values.begin(), values.begin() + std::max(0, std::min(key, n)));
+      std::set<int> greater_master(values.begin() + std::max(0, std::min(key, n)), values.end());
+      equals_helper(less_master, tree);
+      equals_helper(greater_master, greater);
+      threads_helper(less_master, tree);
+      threads_helper(greater_master, greater);
+      tree.join(std::move(greater));
+      validate_helper(tree);
+      equals_helper(values, tree);
+      threads_helper(values, tree);
+      ASSERT_EQ(0u, greater.size());
+    }
+  }
+}
+
+TEST(RedBlackTreeTestSplitOrderStatistics) {
+  RedBlackTree<int, OrderStatisticNode<int>, std::less<int>> tree;
+  for (int j = 0; j < 1000; j++) {
+    tree.insert((j * 7919) % 1000);
+  }
+  auto greater = tree.split(600);
+  validate_helper(tree);
+  validate_helper(greater);
+  ASSERT_EQ(600u, tree.size());
+  ASSERT_EQ(400u, greater.size());
+  ASSERT_EQ(600, greater.select(0)->value());
+  ASSERT_EQ(599, tree.select(599)->value());
+  ASSERT_EQ(200u, greater.rank(800));
+}
+
+template <typename NodeType>
+static void set_operations_helper(unsigned parallelism) {
+  typedef RedBlackTree<int, NodeType, std::less<int>> Tree;
+  int sizes[] = {0, 1, 10, 1000, 5000};
+  for (int a_size : sizes) {
+    for (int b_size : sizes) {
+      std::set<int> a_master;
+      std::set<int> b_master;
+      Tree a;
+      Tree b;
+      for (int j = 0; j < a_size; j++) {
+        int value = (j * 7919) % (2 * a_size + 1);
+        a.insert(value);
+        a_master.insert(value);
+      }
+      for (int j = 0; j < b_size; j++) {
+        int value = (j * 104729) % (3 * b_size + 1);
+        b.insert(value);
+        b_master.insert(value);
+      }
+      std::set<int> expected;
+      std::set_intersection(a_master.begin(), a_master.end(), b_master.begin(), b_master.end(),
+          std::inserter(expected, expected.begin()));
+      Tree intersection(a_master.begin(), a_master.end());
+      intersection.intersect_with(b, parallelism);
+      validate_helper(intersection);
+      equals_helper(expected, intersection);
+
+      expected.clear();
+      std::set_difference(a_master.begin(), a_master.end(), b_master.begin(), b_master.end(),
+          std::inserter(expected, expected.begin()));
+      Tree difference(a_master.begin(), a_master.end());
+      difference.difference_with(b, parallelism);
+      validate_helper(difference);
+      equals_helper(expected, difference);
+
+      expected = a_master;
+      expected.insert(b_master.begin(), b_master.end());
+      a.union_with(std::move(b), parallelism);
+      validate_helper(a);
+      equals_helper(expected, a);
+      ASSERT_EQ(0u, b.size());
+    }
+  }
+}
+
+TEST(RedBlackTreeTestSetOperations) {
+  set_operations_helper<Node<int>>(1);
+  set_operations_helper<OrderStatisticNode<int>>(1);
+}
+
+TEST(RedBlackTreeTestParallelSetOperations) {
+  set_operations_helper<Node<int>>(4);
+}
+
+TEST(RedBlackTreeTestLinkedSetOperations) {
+  typedef RedBlackTree<int, LinkedNode<int>, std::less<int>> Tree;
+  std::set<int> master;
+  Tree a;
+  Tree b;
+  for (int j = 0; j < 5000; j++) {
+    a.insert(2 * j);
+    b.insert(3 * j);
+    master.insert(2 * j);
+    if (3 * j < 9000) {
+      master.insert(3 * j);
+    }
+  }
+  // b shares its pool with the split-off tree, so its values are copied.
+  Tree b_greater = b.split(9000);
+  a.union_with(std::move(b), 4);
+  validate_helper(a);
+  threads_helper(master, a);
+  a.difference_with(b_greater);
+  for (int j = 3000; j < 5000; j++) {
+    master.erase(3 * j);
+  }
+  validate_helper(a);
+  threads_helper(master, a);
+}
+
+template <typename NodeType>
+static void find_batch_helper() {
+  RedBlackTree<int, NodeType, std::less<int>> tree;
+  for (int j = 0; j < 1000; j += 2) {
+    tree.insert(j);
+  }
+  std::vector<int> keys;
+  for (int j = 0; j < 1000; j++) {
+    keys.push_back((j * 7919) % 1003);
+  }
+  std::vector<const NodeType*> nodes;
+  tree.find_batch(keys.begin(), keys.end(), std::back_inserter(nodes));
+  std::vector<bool> found;
+  tree.contains_batch(keys.begin(), keys.end(), std::back_inserter(found));
+  ASSERT_EQ(keys.size(), nodes.size());
+  ASSERT_EQ(keys.size(), found.size());
+  for (size_t j = 0; j < keys.size(); j++) {
+    ASSERT_TRUE(nodes[j] == tree.node(keys[j]));
+    ASSERT_EQ(tree.contains(keys[j]), found[j]);
+  }
+  RedBlackTree<int, NodeType, std::less<int>> empty;
+  nodes.clear();
+  empty.find_batch(keys.begin(), keys.begin() + 3, std::back_inserter(nodes));
+  ASSERT_EQ(3u, nodes.size());
+  ASSERT_NULL(nodes[0]);
+}
+
+TEST(RedBlackTreeTestFindBatch) {
+  find_batch_helper<Node<int>>();
+  find_batch_helper<LinkedNode<int>>();
+}
+
+template <typename NodeType>
+static void ordered_access_helper() {
+  RedBlackTree<int, NodeType, std::less<int>> tree;
+  ASSERT_NULL(tree.first_node());
+  ASSERT_TRUE(tree.begin() == tree.end());
+  std::vector<int> master;
+  for (int j = 0; j < 200; j++) {
+    tree.insert((j * 7919) % 401 * 2);
+  }
+  for (int j = 0; j < 200; j++) {
+    master.push_back((j * 7919) % 401 * 2);
+  }
+  std::sort(master.begin(), master.end());
+  ASSERT_EQ(master.front(), tree.first_node()->value());
+  ASSERT_EQ(master.back(), tree.last_node()->value());
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), tree.begin()));
+  ASSERT_TRUE(std::equal(master.rbegin(), master.rend(), tree.rbegin()));
+  ASSERT_EQ(master.size(), static_cast<size_t>(std::distance(tree.begin(), tree.end())));
+  for (int key = -1; key <= 802; key++) {
+    auto lower = std::lower_bound(master.begin(), master.end(), key);
+    auto upper = std::upper_bound(master.begin(), master.end(), key);
+    auto range = tree.equal_range(key);
+    ASSERT_EQ(lower - master.begin(), std::distance(tree.begin(), tree.lower_bound(key)));
+    ASSERT_EQ(upper - master.begin(), std::distance(tree.begin(), tree.upper_bound(key)));
+    ASSERT_TRUE(range.first == tree.lower_bound(key));
+    ASSERT_TRUE(range.second == tree.upper_bound(key));
+  }
+  for (int lo = -1; lo <= 802; lo += 37) {
+    for (int hi = lo - 1; hi <= 802; hi += 53) {
+      std::vector<int> expected;
+      for (int value : master) {
+        if (lo <= value && value <= hi) {
+          expected.push_back(value);
+        }
+      }
+      std::vector<int> actual;
+      tree.for_each_in_range(lo, hi, [&actual](const int& value) { actual.push_back(value); });
+      ASSERT_TRUE(expected == actual);
+    }
+  }
+}
+
+TEST(RedBlackTreeTestOrderedAccess) {
+  ordered_access_helper<Node<int>>();
+  ordered_access_helper<LinkedNode<int>>();
+  ordered_access_helper<OrderStatisticNode<int>>();
+}
+
+template <typename NodeType, typename Check>
+static void erase_helper(Check check) {
+  typedef RedBlackTree<int, NodeType, std::less<int>> Tree;
+  std::set<int> master;
+  Tree tree;
+  for (int j = 0; j < 1000; j++) {
+    tree.insert(j);
+    master.insert(j);
+  }
+  ASSERT_EQ(0u, tree.erase_range(10, 9));
+  ASSERT_EQ(1u, tree.erase_range(500, 500));
+  master.erase(500);
+  ASSERT_EQ(100u, tree.erase_range(-50, 99));
+  master.erase(master.begin(), master.lower_bound(100));
+  ASSERT_EQ(200u, tree.erase_range(400, 600));
+  master.erase(master.lower_bound(400), master.upper_bound(600));
+  ASSERT_EQ(0u, tree.erase_range(450, 550));
+  validate_helper(tree);
+  equals_helper(master, tree);
+  check(master, tree);
+
+  ASSERT_EQ(0u, tree.erase_if([](const int&) { return false; }));
+  uint32_t expected = 0;
+  for (int value : master) {
+    expected += value % 3 == 0;
+  }
+  ASSERT_EQ(expected, tree.erase_if([](const int& value) { return value % 3 == 0; }));
+  for (auto iter = master.begin(); iter != master.end();) {
+    iter = *iter % 3 == 0 ? master.erase(iter) : std::next(iter);
+  }
+  validate_helper(tree);
+  equals_helper(master, tree);
+  check(master, tree);
+  tree.insert(3);
+  master.insert(3);
+  validate_helper(tree);
+  check(master, tree);
+
+  ASSERT_EQ(master.size(), tree.erase_range(0, 1000));
+  ASSERT_NULL(tree.root());
+  ASSERT_EQ(0u, tree.size());
+}
+
+TEST(RedBlackTreeTestErase) {
+  auto ignore = [](const std::set<int>&, const RedBlackTree<int, Node<int>, std::less<int>>&) {};
+  erase_helper<Node<int>>(ignore);
+  erase_helper<LinkedNode<int>>(
+      [](const std::set<int>& master, const RedBlackTree<int, LinkedNode<int>, std::less<int>>& tree) {
+        threads_helper(master, tree);
+      });
+  erase_helper<OrderStatisticNode<int>>(
+      [](const std::set<int>& master,
+          const RedBlackTree<int, OrderStatisticNode<int>, std::less<int>>& tree) {
+        uint32_t rank = 0;
+        for (int value : master) {
+          ASSERT_EQ(rank++, tree.rank(value));
+        }
+      });
+}
+
+template <typename NodeType, typename Check>
+static void hinted_insert_helper(Check check) {
+  typedef RedBlackTree<int, NodeType, std::less<int>> Tree;
+  std::vector<std::vector<int>> streams(4);
+  for (int j = 0; j < 2000; j++) {
+    streams[0].push_back(j);
+    streams[1].push_back(2000 - j);
+    // Sorted but for a little jitter, with duplicates.
+    streams[2].push_back(j + (j * 7919) % 13);
+    // Random.
+    streams[3].push_back((j * 7919) % 2003);
+  }
+  for (const std::vector<int>& stream : streams) {
+    Tree tree;
+    std::set<int> master;
+    typename Tree::const_iterator hint = tree.end();
+    for (int value : stream) {
+      master.insert(value);
+      hint = tree.insert(hint, value);
+      ASSERT_EQ(value, *hint);
+    }
+    validate_helper(tree);
+    equals_helper(master, tree);
+    check(master, tree);
+    // Every hint, right or wrong, yields the same tree.
+    for (int value = -5; value < 2020; value += 3) {
+      master.insert(value);
+      ASSERT_EQ(value, *tree.insert(tree.lower_bound((value * 7919) % 2011), value));
+    }
+    validate_helper(tree);
+    equals_helper(master, tree);
+    check(master, tree);
+  }
+}
+
+TEST(RedBlackTreeTestHintedInsert) {
+  hinted_insert_helper<Node<int>>(
+      [](const std::set<int>&, const RedBlackTree<int, Node<int>, std::less<int>>&) {});
+  hinted_insert_helper<LinkedNode<int>>(
+      [](const std::set<int>& master, const RedBlackTree<int, LinkedNode<int>, std::less<int>>& tree) {
+        threads_helper(master, tree);
+      });
+  hinted_insert_helper<OrderStatisticNode<int>>(
+      [](const std::set<int>& master,
+          const RedBlackTree<int, OrderStatisticNode<int>, std::less<int>>& tree) {
+        uint32_t rank = 0;
+        for (int value : master) {
+          ASSERT_EQ(rank++, tree.rank(value));
+        }
+      });
+}
+
+// Orders unique_ptr<int> by pointee, and accepts plain int keys.
+struct PointeeCompare {
+  typedef void is_transparent;
+
+  static int value(const std::unique_ptr<int>& p) {
+    return *p;
+  }
+
+  static int value(int v) {
+    return v;
+  }
+
+  template <typename A, typename B>
+  bool operator()(const A& a, const B& b) const {
+    return value(a) < value(b);
+  }
+};
+
+TEST(RedBlackTreeTestMoveOnlyValues) {
+  typedef RedBlackTree<std::unique_ptr<int>, LinkedNode<std::unique_ptr<int>>, PointeeCompare> Tree;
+  Tree tree;
+  for (int j = 0; j < 100; j++) {
+    ASSERT_TRUE(tree.insert(std::unique_ptr<int>(new int(j))));
+  }
+  std::unique_ptr<int> duplicate(new int(5));
+  ASSERT_FALSE(tree.insert(std::move(duplicate)));
+  ASSERT_TRUE(duplicate != nullptr);
+  ASSERT_TRUE(tree.emplace(new int(100)));
+  ASSERT_FALSE(tree.emplace(new int(100)));
+  ASSERT_EQ(101u, tree.size());
+
+  Tree::NodeHandle handle = tree.extract(tree.node(42));
+  ASSERT_FALSE(tree.contains(42));
+  ASSERT_EQ(42, *handle.value());
+  *handle.value() = 142;
+  ASSERT_TRUE(tree.insert(std::move(handle)));
+  ASSERT_TRUE(handle.empty());
+  ASSERT_TRUE(tree.contains(142));
+
+  Tree other;
+  Tree::NodeHandle moved = tree.extract(tree.node(7));
+  ASSERT_TRUE(other.insert(std::move(moved)));
+  ASSERT_EQ(7, **other.begin());
+  ASSERT_EQ(100u, tree.size());
+  validate_helper(tree);
+  std::vector<int> values;
+  for (const std::unique_ptr<int>& value : tree) {
+    values.push_back(*value);
+  }
+  ASSERT_TRUE(std::is_sorted(values.begin(), values.end()));
+  ASSERT_EQ(100u, values.size());
+}
+
+template <typename NodeType>
+static void move_only_adopt_helper() {
+  typedef RedBlackTree<std::unique_ptr<int>, NodeType, PointeeCompare> Tree;
+  Tree tree;
+  Tree source;
+  for (int j = 0; j < 300; j++) {
+    (j < 100 ? tree : source).insert(std::unique_ptr<int>(new int(j)));
+  }
+  // The split halves share a pool that neither can hand over, so their values
+  // are moved into nodes of the destination pool.
+  Tree upper = source.split(200);
+  tree.join(std::move(source));
+  ASSERT_EQ(200u, tree.size());
+  ASSERT_EQ(0u, source.size());
+  Tree more;
+  Tree shared = upper.split(250);
+  for (int j = 300; j < 310; j++) {
+    more.insert(std::unique_ptr<int>(new int(j)));
+  }
+  more.union_with(std::move(shared));
+  tree.union_with(std::move(upper));
+  tree.union_with(std::move(more));
+  validate_helper(tree);
+  ASSERT_EQ(310u, tree.size());
+  int expected = 0;
+  for (const std::unique_ptr<int>& value : tree) {
+    ASSERT_EQ(expected++, *value);
+  }
+}
+
+TEST(RedBlackTreeTestMoveOnlyAdopt) {
+  move_only_adopt_helper<Node<std::unique_ptr<int>>>();
+  move_only_adopt_helper<LinkedNode<std::unique_ptr<int>>>();
+  move_only_adopt_helper<MultiNode<std::unique_ptr<int>>>();
+}
+
+template <typename NodeType>
+static void stable_nodes_helper() {
+  RedBlackTree<std::string, NodeType, std::less<std::string>> tree;
+  std::vector<const NodeType*> nodes;
+  for (int j = 0; j < 500; j++) {
+    tree.insert(std::to_string(1000 + j));
+  }
+  for (int j = 0; j < 500; j++) {
+    nodes.push_back(tree.node(std::to_string(1000 + j)));
+  }
+  // Removing values, including those of nodes with two children, leaves the
+  // nodes of the others holding their values.
+  for (int j = 0; j < 500; j += 2) {
+    ASSERT_TRUE(tree.remove(std::to_string(1000 + (j * 7) % 500)));
+    validate_helper(tree);
+  }
+  for (int j = 0; j < 500; j++) {
+    std::string value = std::to_string(1000 + j);
+    if (tree.contains(value)) {
+      ASSERT_TRUE(tree.node(value) == nodes[j]);
+      ASSERT_EQ(value, nodes[j]->value());
+    }
+  }
+  ASSERT_EQ(250, std::distance(tree.begin(), tree.end()));
+}
+
+TEST(RedBlackTreeTestStableNodes) {
+  stable_nodes_helper<Node<std::string>>();
+  stable_nodes_helper<LinkedNode<std::string>>();
+  stable_nodes_helper<OrderStatisticNode<std::string>>();
+}
+
+struct SumPolicy {
+  typedef int64_t value_type;
+
+  static value_type identity() {
+    return 0;
+  }
+
+  static value_type lift(const int& value) {
+    return value;
+  }
+
+  static value_type combine(const value_type& left, const value_type& right) {
+    return left + right;
+  }
+};
+
+// Concatenation is not commutative, so it checks that values combine in order.
+struct ConcatenatePolicy {
+  typedef std::string value_type;
+
+  static value_type identity() {
+    return std::string();
+  }
+
+  static value_type lift(const int& value) {
+    return std::to_string(value) + ",";
+  }
+
+  static value_type combine(const value_type& left, const value_type& right) {
+    return left + right;
+  }
+};
+
+template <typename Policy, typename Tree>
+static void aggregate_helper(const std::set<int>& master, const Tree& tree) {
+  validate_helper(tree);
+  equals_helper(master, tree);
+  for (int lo = -10; lo < 1010; lo += 47) {
+    for (int hi = lo - 3; hi < 1020; hi += 61) {
+      typename Policy::value_type expected = Policy::identity();
+      for (auto iter = master.lower_bound(lo); iter != master.end() && *iter <= hi; ++iter) {
+        expected = Policy::combine(expected, Policy::lift(*iter));
+      }
+      ASSERT_TRUE(expected == tree.aggregate(lo, hi));
+    }
+  }
+}
+
+template <typename Policy>
+static void augmented_helper() {
+  typedef RedBlackTree<int, AugmentedNode<int, Policy>, std::less<int>> Tree;
+  std::set<int> master;
+  Tree tree;
+  ASSERT_TRUE(Policy::identity() == tree.aggregate(0, 100));
+  for (int j = 0; j < 500; j++) {
+    int value = (j * 7919) % 1009;
+    tree.insert(value);
+    master.insert(value);
+  }
+  aggregate_helper<Policy>(master, tree);
+  for (int j = 0; j < 1009; j += 3) {
+    tree.remove(j);
+    master.erase(j);
+  }
+  aggregate_helper<Policy>(master, tree);
+  tree.erase_range(200, 300);
+  master.erase(master.lower_bound(200), master.upper_bound(300));
+  aggregate_helper<Policy>(master, tree);
+
+  Tree greater = tree.split(600);
+  Tree other(master.begin(), master.end());
+  aggregate_helper<Policy>(master, other);
+  for (int j = 0; j < 1000; j += 5) {
+    greater.insert(j);
+    master.insert(j);
+  }
+  tree.union_with(std::move(greater));
+  aggregate_helper<Policy>(master, tree);
+}
+
+TEST(RedBlackTreeTestAugmented) {
+  augmented_helper<SumPolicy>();
+  augmented_helper<ConcatenatePolicy>();
+}
+
+template <typename Tree>
+static void extremes_helper(const std::set<int>& master, const Tree& tree) {
+  validate_helper(tree);
+  if (master.empty()) {
+    ASSERT_NULL(tree.first_node());
+    ASSERT_NULL(tree.last_node());
+    return;
+  }
+  ASSERT_EQ(*master.begin(), tree.first_node()->value());
+  ASSERT_EQ(*master.rbegin(), tree.last_node()->value());
+}
+
+template <typename NodeType>
+static void priority_queue_helper() {
+  typedef RedBlackTree<int, NodeType, std::less<int>> Tree;
+  Tree tree;
+  std::set<int> master;
+  extremes_helper(master, tree);
+  ASSERT_TRUE(tree.pop_min().empty());
+  ASSERT_TRUE(tree.pop_max().empty());
+  for (int j = 0; j < 600; j++) {
+    int value = (j * 7919) % 1009;
+    tree.insert(value);
+    master.insert(value);
+    extremes_helper(master, tree);
+  }
+  for (int j = 0; j < 100; j++) {
+    typename Tree::NodeHandle min = tree.pop_min();
+    ASSERT_EQ(*master.begin(), min.value());
+    master.erase(master.begin());
+    typename Tree::NodeHandle max = tree.pop_max();
+    ASSERT_EQ(*master.rbegin(), max.value());
+    master.erase(std::prev(master.end()));
+    extremes_helper(master, tree);
+  }
+  // Keys move in place, past their neighbors and past either end.
+  for (int j = 0; j < 300; j++) {
+    int from = *std::next(master.begin(), (j * 31) % master.size());
+    int to = (j * 104729) % 1400 - 200;
+    const NodeType* node = tree.node(from);
+    if (master.count(to) != 0 && to != from) {
+      ASSERT_FALSE(tree.update_key(node, to));
+      ASSERT_EQ(from, node->value());
+    } else {
+      ASSERT_TRUE(tree.update_key(node, to));
+      ASSERT_TRUE(tree.node(to) == node);
+      master.erase(from);
+      master.insert(to);
+    }
+    extremes_helper(master, tree);
+    equals_helper(master, tree);
+  }
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), tree.begin()));
+  // Bulk operations keep the extremes too.
+  tree.erase_range(-1000, *std::next(master.begin(), 10));
+  master.erase(master.begin(), std::next(master.begin(), 11));
+  extremes_helper(master, tree);
+  tree.erase_if([](int value) { return value > 900; });
+  master.erase(master.upper_bound(900), master.end());
+  extremes_helper(master, tree);
+  Tree greater = tree.split(500);
+  std::set<int> greater_master(master.lower_bound(500), master.end());
+  master.erase(master.lower_bound(500), master.end());
+  extremes_helper(master, tree);
+  extremes_helper(greater_master, greater);
+  tree.join(std::move(greater));
+  master.insert(greater_master.begin(), greater_master.end());
+  extremes_helper(master, tree);
+  Tree moved(std::move(tree));
+  extremes_helper(master, moved);
+  extremes_helper(std::set<int>(), tree);
+  moved.clear();
+  extremes_helper(std::set<int>(), moved);
+}
+
+TEST(RedBlackTreeTestPriorityQueue) {
+  priority_queue_helper<Node<int>>();
+  priority_queue_helper<LinkedNode<int>>();
+  priority_queue_helper<OrderStatisticNode<int>>();
+}
+
+TEST(RedBlackTreeTestMultiset) {
+  typedef RedBlackTree<int, MultiNode<int>, std::less<int>> Tree;
+  Tree tree;
+  std::multiset<int> master;
+  for (int j = 0; j < 5000; j++) {
+    // A skewed distribution: a few values account for most occurrences.
+    int value = j % 4 == 0 ? (j * 7919) % 1009 : (j * 104729) % 7;
+    ASSERT_TRUE(tree.insert(value));
+    master.insert(value);
+  }
+  validate_helper(tree);
+  std::set<int> distinct(master.begin(), master.end());
+  ASSERT_EQ(distinct.size(), tree.size());
+  ASSERT_TRUE(std::equal(distinct.begin(), distinct.end(), tree.begin()));
+  for (int j = -1; j < 1010; j++) {
+    ASSERT_EQ(master.count(j), tree.count(j));
+  }
+  // Duplicates are counted in the node already present.
+  const MultiNode<int>* node = tree.node(3);
+  size_t nodes = distinct.size();
+  for (int j = 0; j < 100; j++) {
+    ASSERT_TRUE(tree.emplace(3));
+    master.insert(3);
+  }
+  ASSERT_TRUE(tree.node(3) == node);
+  ASSERT_EQ(nodes, tree.size());
+  ASSERT_EQ(master.count(3), node->count());
+  for (int j = 0; j < 1010; j += 3) {
+    bool present = master.count(j) != 0;
+    ASSERT_EQ(present, tree.erase_one(j));
+    if (present) {
+      master.erase(master.find(j));
+    }
+  }
+  for (int j = 0; j < 1010; j += 5) {
+    ASSERT_EQ(master.erase(j), tree.erase_all(j));
+  }
+  validate_helper(tree);
+  for (int j = -1; j < 1010; j++) {
+    ASSERT_EQ(master.count(j), tree.count(j));
+  }
+  // A union adds up the occurrences of values present in both trees.
+  Tree other;
+  for (int j = 0; j < 20; j++) {
+    other.insert(j % 10);
+    master.insert(j % 10);
+  }
+  tree.union_with(std::move(other));
+  validate_helper(tree);
+  for (int j = -1; j < 1010; j++) {
+    ASSERT_EQ(master.count(j), tree.count(j));
+  }
+  if (sizeof(void*) == 8) {
+    ASSERT_EQ(sizeof(Node<int>), sizeof(MultiNode<int>));
+  }
+  // Other node types count each value at most once.
+  RedBlackTree<int, Node<int>, std::less<int>> set;
+  ASSERT_TRUE(set.insert(1));
+  ASSERT_FALSE(set.insert(1));
+  ASSERT_EQ(1u, set.count(1));
+  ASSERT_TRUE(set.erase_one(1));
+  ASSERT_EQ(0u, set.erase_all(1));
+}
+
+TEST(RedBlackTreeTestMultisetOccurrences) {
+  typedef RedBlackTree<int, MultiNode<int>, std::less<int>> Tree;
+  Tree tree;
+  Tree other;
+  std::multiset<int> master;
+  for (int j = 0; j < 100; j++) {
+    for (int k = 0; k <= j % 4; k++) {
+      tree.insert(j);
+      master.insert(j);
+    }
+  }
+  // A handle carries every occurrence of its value, whether it is linked in,
+  // merged into an equivalent value or moved into a node of another pool.
+  Tree::NodeHandle handle = tree.extract(tree.node(3));
+  ASSERT_EQ(0u, tree.count(3));
+  ASSERT_TRUE(tree.insert(std::move(handle)));
+  ASSERT_TRUE(handle.empty());
+  ASSERT_EQ(master.count(3), tree.count(3));
+  tree.insert(7);
+  master.insert(7);
+  handle = tree.extract(tree.node(7));
+  ASSERT_EQ(0u, tree.count(7));
+  tree.insert(7);
+  ASSERT_TRUE(tree.insert(std::move(handle)));
+  ASSERT_TRUE(handle.empty());
+  master.insert(7);
+  ASSERT_EQ(master.count(7), tree.count(7));
+  ASSERT_TRUE(other.insert(tree.extract(tree.node(11))));
+  ASSERT_EQ(master.count(11), other.count(11));
+  ASSERT_TRUE(tree.insert(other.extract(other.node(11))));
+  ASSERT_EQ(master.count(11), tree.count(11));
+  other.insert(15);
+  ASSERT_TRUE(tree.insert(other.extract(other.node(15))));
+  master.insert(15);
+  ASSERT_EQ(master.count(15), tree.count(15));
+  ASSERT_EQ(0u, other.size());
+  validate_helper(tree);
+  // Bulk erasure counts occurrences, as erase_all does.
+  uint32_t expected = 0;
+  for (int j = 10; j <= 30; j++) {
+    expected += static_cast<uint32_t>(master.erase(j));
+  }
+  ASSERT_EQ(expected, tree.erase_range(10, 30));
+  expected = 0;
+  for (int j = 0; j < 100; j += 2) {
+    expected += static_cast<uint32_t>(master.erase(j));
+  }
+  ASSERT_EQ(expected, tree.erase_if([](int value) { return value % 2 == 0; }));
+  validate_helper(tree);
+  for (int j = -1; j <= 100; j++) {
+    ASSERT_EQ(master.count(j), tree.count(j));
+  }
+}
+
+#ifdef NODE_POOL_HAS_PMR
+TEST(RedBlackTreeTestMemoryResource) {
+  typedef PmrRedBlackTree<int, LinkedNode<int>, std::less<int>> Tree;
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::monotonic_buffer_resource other_arena;
+  std::set<int> master;
+  Tree tree{std::less<int>(), std::pmr::polymorphic_allocator<int>(&arena)};
+  for (int j = 0; j < 1000; j++) {
+    tree.insert((j * 7919) % 1009);
+    master.insert((j * 7919) % 1009);
+  }
+  // A tree on the same arena hands its storage over; one on another arena has
+  // its values copied.
+  Tree same{std::less<int>(), std::pmr::polymorphic_allocator<int>(&arena)};
+  Tree other{std::less<int>(), std::pmr::polymorphic_allocator<int>(&other_arena)};
+  for (int j = 1000; j < 1100; j++) {
+    same.insert(j);
+    other.insert(j + 100);
+    master.insert(j);
+    master.insert(j + 100);
+  }
+  tree.union_with(std::move(same));
+  tree.union_with(std::move(other));
+  validate_helper(tree);
+  threads_helper(master, tree);
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), tree.begin()));
+  tree.erase_range(0, 500);
+  master.erase(master.begin(), master.upper_bound(500));
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), tree.begin()));
+}
+#endif
+
+TEST(RedBlackTreeTestStats) {
+  typedef RedBlackTree<int, Node<int>, std::less<int>> Tree;
+  Tree tree;
+  RedBlackTreeStats stats = tree.stats();
+  ASSERT_EQ(0u, stats.size);
+  ASSERT_EQ(0u, stats.height);
+  ASSERT_EQ(0u, stats.black_height);
+  for (int j = 0; j < 1000; j++) {
+    tree.insert(j);
+  }
+  stats = tree.stats();
+  ASSERT_EQ(1000u, stats.size);
+  ASSERT_GTE(stats.height, 10u);
+  ASSERT_LTE(stats.height, 2 * stats.black_height);
+  ASSERT_EQ(1000 * sizeof(Node<int>), stats.node_bytes);
+  ASSERT_GTE(stats.pool_bytes, stats.node_bytes);
+#ifdef RED_BLACK_TREE_COUNTERS
+  // Ascending insertion rotates and recolors all the way.
+  ASSERT_EQ(1000, stats.counters.allocations);
+  ASSERT_GT(stats.counters.comparisons, 1000 * 8);
+  ASSERT_GT(stats.counters.rotations, 900);
+  ASSERT_GT(stats.counters.recolorings, 1000);
+  ASSERT_GT(stats.counters.fixup_iterations, 1000);
+  RedBlackTreeCounters before = stats.counters;
+  ASSERT_TRUE(tree.contains(500));
+  stats = tree.stats();
+  ASSERT_GT(stats.counters.comparisons, before.comparisons);
+  ASSERT_EQ(before.rotations, stats.counters.rotations);
+#else
+  ASSERT_EQ(0u, stats.counters.comparisons);
+  ASSERT_EQ(0u, stats.counters.allocations);
+#endif
+}
+
+template <typename Tree>
+static void ends_helper(const std::set<int>& master, Tree& tree) {
+  extremes_helper(master, tree);
+  ASSERT_TRUE(std::equal(master.begin(), master.end(), tree.begin()));
+  ASSERT_TRUE(std::equal(master.rbegin(), master.rend(), tree.rbegin()));
+}
+
+template <typename NodeType>
+static void set_operation_extremes_helper() {
+  typedef RedBlackTree<int, NodeType, std::less<int>> Tree;
+  std::set<int> master;
+  Tree tree;
+  for (int j = 0; j < 300; j++) {
+    tree.insert(j);
+    master.insert(j);
+  }
+  Tree greater = tree.split(200);
+  std::set<int> greater_master(master.lower_bound(200), master.end());
+  master.erase(master.lower_bound(200), master.end());
+  ends_helper(master, tree);
+  ends_helper(greater_master, greater);
+  ASSERT_EQ(199, tree.pop_max().value());
+  master.erase(199);
+  ASSERT_EQ(200, greater.pop_min().value());
+  greater_master.erase(200);
+  ends_helper(master, tree);
+  ends_helper(greater_master, greater);
+
+  Tree subtrahend;
+  for (int j = 0; j < 50; j++) {
+    subtrahend.insert(j);
+    master.erase(j);
+  }
+  tree.difference_with(subtrahend);
+  ends_helper(master, tree);
+  Tree other;
+  for (int j = 100; j < 150; j++) {
+    other.insert(j);
+  }
+  tree.intersect_with(other);
+  master.erase(master.begin(), master.lower_bound(100));
+  master.erase(master.lower_bound(150), master.end());
+  ends_helper(master, tree);
+  tree.union_with(std::move(greater));
+  master.insert(greater_master.begin(), greater_master.end());
+  ends_helper(master, tree);
+  tree.erase_range(140, 250);
+  master.erase(master.lower_bound(140), master.upper_bound(250));
+  ends_helper(master, tree);
+  ASSERT_EQ(100, tree.pop_min().value());
+  ASSERT_EQ(299, tree.pop_max().value());
+  master.erase(100);
+  master.erase(299);
+  ends_helper(master, tree);
+
+  // A difference leaving a single value keeps the head and tail correct.
+  Tree pair;
+  pair.insert(0);
+  pair.insert(1);
+  Tree zero;
+  zero.insert(0);
+  pair.difference_with(zero);
+  ends_helper(std::set<int>({1}), pair);
+}
+
+TEST(RedBlackTreeTestSetOperationExtremes) {
+  set_operation_extremes_helper<Node<int>>();
+  set_operation_extremes_helper<LinkedNode<int>>();
+  set_operation_extremes_helper<OrderStatisticNode<int>>();
+  set_operation_extremes_helper<MultiNode<int>>();
+}
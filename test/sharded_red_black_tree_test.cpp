@@ -0,0 +1,115 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <atomic>
+#include <functional>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "sharded_red_black_tree.h"
+
+typedef ShardedRedBlackTree<int, std::less<int>> Tree;
+
+static std::vector<int> contents(const Tree& tree) {
+  std::vector<int> values;
+  tree.for_each([&values](int value) { values.push_back(value); });
+  return values;
+}
+
+TEST(ShardedRedBlackTreeSplitsAndJoins) {
+  Tree tree(std::less<int>(), 64);
+  std::set<int> expected;
+  for (int j = 0; j < 5000; j++) {
+    // A skewed distribution: most values fall in a narrow band.
+    int value = j % 5 == 0 ? (j * 7919) % 100000 : 50000 + (j * 104729) % 2000;
+    ASSERT_EQ(expected.insert(value).second, tree.insert(value));
+  }
+  ASSERT_EQ(expected.size(), tree.size());
+  ASSERT_GT(tree.shard_count(), expected.size() / 64);
+  ASSERT_TRUE(std::vector<int>(expected.begin(), expected.end()) == contents(tree));
+  for (int lo = -500; lo < 101000; lo += 997) {
+    std::vector<int> actual;
+    tree.for_each_in_range(lo, lo + 3000, [&actual](int value) { actual.push_back(value); });
+    ASSERT_TRUE(std::vector<int>(expected.lower_bound(lo), expected.upper_bound(lo + 3000))
+        == actual);
+  }
+  for (int j = 0; j < 100000; j++) {
+    ASSERT_EQ(expected.count(j) == 1, tree.contains(j));
+  }
+  size_t shards = tree.shard_count();
+  std::vector<int> values(expected.begin(), expected.end());
+  for (size_t j = 0; j < values.size(); j++) {
+    if (j % 10 != 0) {
+      ASSERT_TRUE(tree.remove(values[j]));
+      expected.erase(values[j]);
+    }
+  }
+  ASSERT_FALSE(tree.remove(values[1]));
+  ASSERT_LT(tree.shard_count(), shards);
+  ASSERT_EQ(expected.size(), tree.size());
+  ASSERT_TRUE(std::vector<int>(expected.begin(), expected.end()) == contents(tree));
+}
+
+TEST(ShardedRedBlackTreeConcurrentWriters) {
+  Tree tree(std::less<int>(), 128);
+  std::atomic<bool> done(false);
+  std::atomic<int> failures(0);
+  std::thread reader([&tree, &done, &failures]() {
+    while (!done.load()) {
+      int previous = -1;
+      tree.for_each_in_range(0, 1 << 30, [&previous, &failures](int value) {
+        if (value <= previous) {
+          failures.fetch_add(1);
+        }
+        previous = value;
+      });
+    }
+  });
+  std::vector<std::thread> writers;
+  for (int t = 0; t < 4; t++) {
+    writers.push_back(std::thread([&tree, &failures, t]() {
+      for (int j = 0; j < 4000; j++) {
+        if (!tree.insert(j * 4 + t)) {
+          failures.fetch_add(1);
+        }
+      }
+      for (int j = 0; j < 4000; j += 2) {
+        if (!tree.remove(j * 4 + t)) {
+          failures.fetch_add(1);
+        }
+      }
+    }));
+  }
+  for (std::thread& writer : writers) {
+    writer.join();
+  }
+  done.store(true);
+  reader.join();
+  ASSERT_EQ(0, failures.load());
+  ASSERT_EQ(8000u, tree.size());
+  std::vector<int> values = contents(tree);
+  ASSERT_EQ(8000u, values.size());
+  for (size_t j = 0; j < values.size(); j++) {
+    ASSERT_EQ(static_cast<int>((j / 4) * 8 + 4 + j % 4), values[j]);
+  }
+}
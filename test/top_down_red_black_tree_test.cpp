@@ -0,0 +1,128 @@
+/* Copyright (c) 2013 Kevin L. Stern
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include "test.h"
+
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "top_down_red_black_tree.h"
+
+template <typename NodeType>
+static int validate_helper(const NodeType* node) {
+  if (node == nullptr) {
+    return 1;
+  }
+  if (node->color() == RED) {
+    ASSERT_TRUE(node->left() == nullptr || node->left()->color() == BLACK);
+    ASSERT_TRUE(node->right() == nullptr || node->right()->color() == BLACK);
+  }
+  int left = validate_helper(node->left());
+  int right = validate_helper(node->right());
+  ASSERT_EQ(left, right);
+  return left + (node->color() == BLACK ? 1 : 0);
+}
+
+template <typename Tree, typename Collection>
+static void equals_helper(const Collection& master, const Tree& tree) {
+  ASSERT_TRUE(tree.root() == nullptr || tree.root()->color() == BLACK);
+  validate_helper(tree.root());
+  ASSERT_EQ(master.size(), tree.size());
+  std::vector<typename Collection::value_type> values;
+  tree.for_each([&values](const typename Collection::value_type& value) {
+    values.push_back(value);
+  });
+  ASSERT_TRUE(std::vector<typename Collection::value_type>(master.begin(), master.end()) == values);
+}
+
+TEST(TopDownRedBlackTreeTestInsertRemove) {
+  TopDownRedBlackTree<int, std::less<int>> tree;
+  std::set<int> master;
+  for (int j = 0; j < 3000; j++) {
+    int value = (j * 7919) % 2003;
+    ASSERT_EQ(master.insert(value).second, tree.insert(value));
+    if (j % 100 == 0) {
+      equals_helper(master, tree);
+    }
+  }
+  equals_helper(master, tree);
+  for (int j = -1; j < 2005; j++) {
+    ASSERT_EQ(master.count(j) == 1, tree.contains(j));
+  }
+  for (int j = 0; j < 3000; j++) {
+    int value = (j * 104729) % 2100;
+    ASSERT_EQ(master.erase(value) == 1, tree.remove(value));
+    if (j % 100 == 0) {
+      equals_helper(master, tree);
+    }
+  }
+  equals_helper(master, tree);
+  for (int value : std::vector<int>(master.begin(), master.end())) {
+    ASSERT_TRUE(tree.remove(value));
+  }
+  ASSERT_NULL(tree.root());
+  ASSERT_TRUE(tree.empty());
+  ASSERT_FALSE(tree.remove(0));
+}
+
+TEST(TopDownRedBlackTreeTestRange) {
+  TopDownRedBlackTree<int, std::less<int>> tree;
+  std::set<int> master;
+  for (int j = 0; j < 1000; j++) {
+    int value = (j * 7919) % 4001;
+    tree.insert(value);
+    master.insert(value);
+  }
+  for (int lo = -10; lo < 4020; lo += 37) {
+    std::vector<int> actual;
+    tree.for_each_in_range(lo, lo + 100, [&actual](int value) { actual.push_back(value); });
+    ASSERT_TRUE(std::vector<int>(master.lower_bound(lo), master.upper_bound(lo + 100)) == actual);
+  }
+  std::vector<int> actual;
+  tree.for_each_in_range(10, 5, [&actual](int value) { actual.push_back(value); });
+  ASSERT_TRUE(actual.empty());
+}
+
+TEST(TopDownRedBlackTreeTestValues) {
+  // Deletion moves values between nodes, which must leave each intact.
+  TopDownRedBlackTree<std::string, std::less<std::string>> tree;
+  std::set<std::string> master;
+  for (int j = 0; j < 500; j++) {
+    std::string value = std::string(20, 'a' + j % 26) + std::to_string((j * 31) % 500);
+    tree.insert(value);
+    master.insert(value);
+  }
+  for (int j = 0; j < 500; j += 3) {
+    std::string value = std::string(20, 'a' + j % 26) + std::to_string((j * 31) % 500);
+    ASSERT_TRUE(tree.remove(value));
+    master.erase(value);
+  }
+  equals_helper(master, tree);
+  tree.clear();
+  ASSERT_EQ(0u, tree.size());
+  ASSERT_TRUE(tree.insert("x"));
+  ASSERT_TRUE(tree.contains(std::string("x")));
+}
+
+TEST(TopDownRedBlackTreeTestNodeSize) {
+  ASSERT_EQ(sizeof(Node<int>) - 2 * sizeof(void*), sizeof(TopDownNode<int>));
+}